@@ -36,6 +36,29 @@
 /* statistics */
 int tlb_flush_count;
 
+static void tlb_reset_large_pages(CPUArchState *env)
+{
+    int i;
+
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        env->tlb_large_pages[i].addr = -1;
+        env->tlb_large_pages[i].mask = 0;
+    }
+}
+
+/* Invalidate every entry of one MMU mode, unless it has none since the
+   last flush.  Most guests only use a couple of the modes at any time.  */
+static void tlb_flush_one_mmuidx(CPUArchState *env, int mmu_idx)
+{
+    if (env->tlb_clean & (1u << mmu_idx)) {
+        env->tlb_stats.skipped_flushes++;
+        return;
+    }
+    memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
+    memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+    env->tlb_clean |= 1u << mmu_idx;
+}
+
 /* NOTE:
  * If flush_global is true (the usual case), flush all tlb entries.
  * If flush_global is false, flush (at least) all tlb entries not
@@ -51,6 +74,7 @@ int tlb_flush_count;
 void tlb_flush(CPUState *cpu, int flush_global)
 {
     CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
 
 #if defined(DEBUG_TLB)
     printf("tlb_flush:\n");
@@ -59,91 +83,154 @@ void tlb_flush(CPUState *cpu, int flush_global)
        links while we are modifying them */
     cpu->current_tb = NULL;
 
-    memset(env->tlb_table, -1, sizeof(env->tlb_table));
-    memset(env->tlb_v_table, -1, sizeof(env->tlb_v_table));
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        tlb_flush_one_mmuidx(env, mmu_idx);
+    }
     memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
 
     env->vtlb_index = 0;
-    env->tlb_flush_addr = -1;
-    env->tlb_flush_mask = 0;
+    tlb_reset_large_pages(env);
+    env->tlb_stats.full_flushes++;
     tlb_flush_count++;
 }
 
-static inline void v_tlb_flush_by_mmuidx(CPUState *cpu, va_list argp)
+/* Flush all entries of the MMU modes in the bitmap @idxmap */
+static void tlb_flush_idxmap(CPUState *cpu, uint32_t idxmap)
 {
     CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
+
+    if ((idxmap & TLB_ALL_MMUIDX) == TLB_ALL_MMUIDX) {
+        tlb_flush(cpu, 1);
+        return;
+    }
 
 #if defined(DEBUG_TLB)
-    printf("tlb_flush_by_mmuidx:");
+    printf("tlb_flush_by_mmuidx: %#x\n", idxmap);
 #endif
     /* must reset current TB so that interrupts cannot modify the
        links while we are modifying them */
     cpu->current_tb = NULL;
 
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if (idxmap & (1u << mmu_idx)) {
+            tlb_flush_one_mmuidx(env, mmu_idx);
+        }
+    }
+
+    memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
+    env->tlb_stats.full_flushes++;
+}
+
+/* Turn a negative-terminated list of MMU indexes into a bitmap */
+static uint32_t va_idxmap(va_list argp)
+{
+    uint32_t idxmap = 0;
+
     for (;;) {
         int mmu_idx = va_arg(argp, int);
 
         if (mmu_idx < 0) {
             break;
         }
-
-#if defined(DEBUG_TLB)
-        printf(" %d", mmu_idx);
-#endif
-
-        memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
-        memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+        idxmap |= 1u << mmu_idx;
     }
-
-#if defined(DEBUG_TLB)
-    printf("\n");
-#endif
-
-    memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
+    return idxmap;
 }
 
 void tlb_flush_by_mmuidx(CPUState *cpu, ...)
 {
     va_list argp;
     va_start(argp, cpu);
-    v_tlb_flush_by_mmuidx(cpu, argp);
+    tlb_flush_idxmap(cpu, va_idxmap(argp));
     va_end(argp);
 }
 
-static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
+/* Invalidate @tlb_entry if it maps a page in @addr/@mask */
+static inline void tlb_flush_entry_masked(CPUTLBEntry *tlb_entry,
+                                          target_ulong addr,
+                                          target_ulong mask)
 {
-    if (addr == (tlb_entry->addr_read &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
-        addr == (tlb_entry->addr_write &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
-        addr == (tlb_entry->addr_code &
-                 (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
+    mask |= TLB_INVALID_MASK;
+    if (addr == (tlb_entry->addr_read & mask) ||
+        addr == (tlb_entry->addr_write & mask) ||
+        addr == (tlb_entry->addr_code & mask)) {
         memset(tlb_entry, -1, sizeof(*tlb_entry));
     }
 }
 
+static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
+{
+    tlb_flush_entry_masked(tlb_entry, addr, TARGET_PAGE_MASK);
+}
+
+/* Return the large page area that @addr falls in, or NULL */
+static CPUTLBLargePage *tlb_find_large_page(CPUArchState *env,
+                                            target_ulong addr)
+{
+    int i;
+
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &env->tlb_large_pages[i];
+
+        if ((addr & lp->mask) == lp->addr) {
+            return lp;
+        }
+    }
+    return NULL;
+}
+
+/* Invalidate the entries of @mmu_idx that map any page of @lp.  The
+   area is small compared to the address space, so scanning the TLB is
+   cheaper than flushing it and refilling every other mapping.  */
+static void tlb_flush_large_page_mmuidx(CPUArchState *env, int mmu_idx,
+                                        CPUTLBLargePage *lp)
+{
+    int i;
+
+    if (env->tlb_clean & (1u << mmu_idx)) {
+        return;
+    }
+    for (i = 0; i < CPU_TLB_SIZE; i++) {
+        tlb_flush_entry_masked(&env->tlb_table[mmu_idx][i],
+                               lp->addr, lp->mask);
+    }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        tlb_flush_entry_masked(&env->tlb_v_table[mmu_idx][i],
+                               lp->addr, lp->mask);
+    }
+}
+
 void tlb_flush_page(CPUState *cpu, target_ulong addr)
 {
     CPUArchState *env = cpu->env_ptr;
+    CPUTLBLargePage *lp;
     int i;
     int mmu_idx;
 
 #if defined(DEBUG_TLB)
     printf("tlb_flush_page: " TARGET_FMT_lx "\n", addr);
 #endif
-    /* Check if we need to flush due to large pages.  */
-    if ((addr & env->tlb_flush_mask) == env->tlb_flush_addr) {
+    /* must reset current TB so that interrupts cannot modify the
+       links while we are modifying them */
+    cpu->current_tb = NULL;
+
+    /* Check if we need to flush a whole large page.  */
+    lp = tlb_find_large_page(env, addr);
+    if (lp) {
 #if defined(DEBUG_TLB)
-        printf("tlb_flush_page: forced full flush ("
-               TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-               env->tlb_flush_addr, env->tlb_flush_mask);
+        printf("tlb_flush_page: flushing large page ("
+               TARGET_FMT_lx "/" TARGET_FMT_lx ")\n", lp->addr, lp->mask);
 #endif
-        tlb_flush(cpu, 1);
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            tlb_flush_large_page_mmuidx(env, mmu_idx, lp);
+        }
+        memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
+        lp->addr = -1;
+        lp->mask = 0;
+        env->tlb_stats.large_page_flushes++;
         return;
     }
-    /* must reset current TB so that interrupts cannot modify the
-       links while we are modifying them */
-    cpu->current_tb = NULL;
 
     addr &= TARGET_PAGE_MASK;
     i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
@@ -154,54 +241,63 @@ void tlb_flush_page(CPUState *cpu, target_ulong addr)
     /* check whether there are entries that need to be flushed in the vtlb */
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         int k;
+
+        if (env->tlb_clean & (1u << mmu_idx)) {
+            continue;
+        }
         for (k = 0; k < CPU_VTLB_SIZE; k++) {
             tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
         }
     }
 
     tb_flush_jmp_cache(cpu, addr);
+    env->tlb_stats.page_flushes++;
 }
 
-void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, ...)
+/* Flush one page from the MMU modes in the bitmap @idxmap */
+static void tlb_flush_page_idxmap(CPUState *cpu, target_ulong addr,
+                                  uint32_t idxmap)
 {
     CPUArchState *env = cpu->env_ptr;
+    CPUTLBLargePage *lp;
     int i, k;
-    va_list argp;
-
-    va_start(argp, addr);
+    int mmu_idx;
 
 #if defined(DEBUG_TLB)
-    printf("tlb_flush_page_by_mmu_idx: " TARGET_FMT_lx, addr);
+    printf("tlb_flush_page_by_mmu_idx: " TARGET_FMT_lx " %#x\n",
+           addr, idxmap);
 #endif
-    /* Check if we need to flush due to large pages.  */
-    if ((addr & env->tlb_flush_mask) == env->tlb_flush_addr) {
+    /* must reset current TB so that interrupts cannot modify the
+       links while we are modifying them */
+    cpu->current_tb = NULL;
+
+    /* Check if we need to flush a whole large page.  The area stays
+       registered, since the other MMU modes may still map it.  */
+    lp = tlb_find_large_page(env, addr);
+    if (lp) {
 #if defined(DEBUG_TLB)
-        printf(" forced full flush ("
-               TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-               env->tlb_flush_addr, env->tlb_flush_mask);
+        printf(" flushing large page ("
+               TARGET_FMT_lx "/" TARGET_FMT_lx ")\n", lp->addr, lp->mask);
 #endif
-        v_tlb_flush_by_mmuidx(cpu, argp);
-        va_end(argp);
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            if (idxmap & (1u << mmu_idx)) {
+                tlb_flush_large_page_mmuidx(env, mmu_idx, lp);
+            }
+        }
+        memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
+        env->tlb_stats.large_page_flushes++;
         return;
     }
-    /* must reset current TB so that interrupts cannot modify the
-       links while we are modifying them */
-    cpu->current_tb = NULL;
 
     addr &= TARGET_PAGE_MASK;
     i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
 
-    for (;;) {
-        int mmu_idx = va_arg(argp, int);
-
-        if (mmu_idx < 0) {
-            break;
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if (!(idxmap & (1u << mmu_idx)) ||
+            (env->tlb_clean & (1u << mmu_idx))) {
+            continue;
         }
 
-#if defined(DEBUG_TLB)
-        printf(" %d", mmu_idx);
-#endif
-
         tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
 
         /* check whether there are vltb entries that need to be flushed */
@@ -209,13 +305,110 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, ...)
             tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], addr);
         }
     }
+
+    tb_flush_jmp_cache(cpu, addr);
+    env->tlb_stats.page_flushes++;
+}
+
+void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, ...)
+{
+    va_list argp;
+
+    va_start(argp, addr);
+    tlb_flush_page_idxmap(cpu, addr, va_idxmap(argp));
     va_end(argp);
+}
 
-#if defined(DEBUG_TLB)
-    printf("\n");
-#endif
+/* Queue a flush of @pages (all of the TLB if @nb_pages is negative) in the
+   MMU modes @idxmap, to be done when @cpu next enters cpu_exec.  */
+static void tlb_queue_flush(CPUState *cpu, const target_ulong *pages,
+                            int nb_pages, uint32_t idxmap)
+{
+    CPUArchState *env = cpu->env_ptr;
+    int i, j;
+
+    if (nb_pages < 0 ||
+        env->tlb_nb_pending + nb_pages > CPU_TLB_PENDING_PAGES) {
+        /* Too many pages: everything queued so far is covered by a full
+           flush of the modes involved.  */
+        for (i = 0; i < env->tlb_nb_pending; i++) {
+            env->tlb_pending_full |= env->tlb_pending[i].idxmap;
+        }
+        env->tlb_pending_full |= idxmap;
+        env->tlb_nb_pending = 0;
+        return;
+    }
 
-    tb_flush_jmp_cache(cpu, addr);
+    for (i = 0; i < nb_pages; i++) {
+        target_ulong addr = pages[i] & TARGET_PAGE_MASK;
+
+        for (j = 0; j < env->tlb_nb_pending; j++) {
+            if (env->tlb_pending[j].addr == addr) {
+                break;
+            }
+        }
+        if (j == env->tlb_nb_pending) {
+            env->tlb_pending[j].addr = addr;
+            env->tlb_pending[j].idxmap = 0;
+            env->tlb_nb_pending++;
+        }
+        env->tlb_pending[j].idxmap |= idxmap;
+    }
+}
+
+void tlb_flush_pages_cpumask(const unsigned long *cpus,
+                             const target_ulong *pages, int nb_pages,
+                             uint32_t idxmap)
+{
+    CPUState *cpu;
+    int i;
+
+    if (nb_pages > CPU_TLB_PENDING_PAGES) {
+        nb_pages = -1;
+    }
+
+    CPU_FOREACH(cpu) {
+        if (cpus && !test_bit(cpu->cpu_index, cpus)) {
+            continue;
+        }
+        if (cpu != current_cpu) {
+            /* With TCG only current_cpu is executing guest code; the
+               others cannot use their TLB before they next enter
+               cpu_exec, which applies the queued flushes.  */
+            tlb_queue_flush(cpu, pages, nb_pages, idxmap);
+        } else if (nb_pages < 0) {
+            tlb_flush_idxmap(cpu, idxmap);
+        } else {
+            for (i = 0; i < nb_pages; i++) {
+                tlb_flush_page_idxmap(cpu, pages[i], idxmap);
+            }
+        }
+    }
+}
+
+void tlb_flush_pending(CPUState *cpu)
+{
+    CPUArchState *env = cpu->env_ptr;
+    uint32_t full = env->tlb_pending_full;
+    int i;
+
+    if (!full && !env->tlb_nb_pending) {
+        return;
+    }
+
+    if (full) {
+        tlb_flush_idxmap(cpu, full);
+    }
+    for (i = 0; i < env->tlb_nb_pending; i++) {
+        uint32_t idxmap = env->tlb_pending[i].idxmap & ~full;
+
+        if (idxmap) {
+            tlb_flush_page_idxmap(cpu, env->tlb_pending[i].addr, idxmap);
+        }
+    }
+    env->tlb_nb_pending = 0;
+    env->tlb_pending_full = 0;
+    env->tlb_stats.remote_flushes++;
 }
 
 /* update the TLBs so that writes to code in the virtual page 'addr'
@@ -313,27 +506,57 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     }
 }
 
-/* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
+/* Our TLB does not support large pages, so remember the areas covered by
+   large pages and flush them as a whole if any page in them is flushed.  */
 static void tlb_add_large_page(CPUArchState *env, target_ulong vaddr,
                                target_ulong size)
 {
     target_ulong mask = ~(size - 1);
+    target_ulong best_mask = 0;
+    CPUTLBLargePage *best = NULL;
+    CPUTLBLargePage *lp;
+    int i;
 
-    if (env->tlb_flush_addr == (target_ulong)-1) {
-        env->tlb_flush_addr = vaddr & mask;
-        env->tlb_flush_mask = mask;
+    vaddr &= mask;
+    lp = tlb_find_large_page(env, vaddr);
+    if (lp) {
+        if ((lp->mask & ~mask) != 0) {
+            /* The area is smaller than the new page, widen it */
+            lp->mask &= mask;
+            lp->addr &= lp->mask;
+        }
         return;
     }
-    /* Extend the existing region to include the new page.
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        lp = &env->tlb_large_pages[i];
+
+        if (lp->addr == (target_ulong)-1 || (lp->addr & mask) == vaddr) {
+            /* Free, or covered by the new page */
+            lp->addr = vaddr;
+            lp->mask = mask;
+            return;
+        }
+    }
+
+    /* All in use: extend the area that needs to grow the least.
        This is a compromise between unnecessary flushes and the cost
        of maintaining a full variable size TLB.  */
-    mask &= env->tlb_flush_mask;
-    while (((env->tlb_flush_addr ^ vaddr) & mask) != 0) {
-        mask <<= 1;
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        target_ulong m;
+
+        lp = &env->tlb_large_pages[i];
+        m = mask & lp->mask;
+
+        while (((lp->addr ^ vaddr) & m) != 0) {
+            m <<= 1;
+        }
+        if (!best || m > best_mask) {
+            best = lp;
+            best_mask = m;
+        }
     }
-    env->tlb_flush_addr &= mask;
-    env->tlb_flush_mask = mask;
+    best->addr &= best_mask;
+    best->mask = best_mask;
 }
 
 /* Add a new TLB entry. At most one entry for a given virtual address
@@ -389,6 +612,8 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
 
     index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     te = &env->tlb_table[mmu_idx][index];
+    env->tlb_clean &= ~(1u << mmu_idx);
+    env->tlb_stats.fills++;
 
     /* do not discard the translation in te, evict it into a victim tlb */
     env->tlb_v_table[mmu_idx][vidx] = *te;
@@ -426,6 +651,45 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     }
 }
 
+void dump_tlb_stats(FILE *f, fprintf_function cpu_fprintf)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+        CPUTLBStats *st = &env->tlb_stats;
+        int i, used = 0;
+
+        for (i = 0; i < NB_MMU_MODES; i++) {
+            if (!(env->tlb_clean & (1u << i))) {
+                used++;
+            }
+        }
+        cpu_fprintf(f, "CPU %d: %d entries per MMU mode, %d of %d modes "
+                    "in use\n", cpu->cpu_index, CPU_TLB_SIZE, used,
+                    NB_MMU_MODES);
+        cpu_fprintf(f, "  misses            %" PRIu64 " (%" PRIu64
+                    " victim TLB hits, %" PRIu64 " refills)\n",
+                    st->victim_hits + st->fills, st->victim_hits, st->fills);
+        cpu_fprintf(f, "  full flushes      %" PRIu64 " (%" PRIu64
+                    " idle modes skipped)\n",
+                    st->full_flushes, st->skipped_flushes);
+        cpu_fprintf(f, "  page flushes      %" PRIu64 "\n", st->page_flushes);
+        cpu_fprintf(f, "  large page flushes %" PRIu64 "\n",
+                    st->large_page_flushes);
+        cpu_fprintf(f, "  remote flushes    %" PRIu64 "\n",
+                    st->remote_flushes);
+        for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+            CPUTLBLargePage *lp = &env->tlb_large_pages[i];
+
+            if (lp->addr != (target_ulong)-1) {
+                cpu_fprintf(f, "  large page area   " TARGET_FMT_lx "/"
+                            TARGET_FMT_lx "\n", lp->addr, lp->mask);
+            }
+        }
+    }
+}
+
 /* Add a new TLB entry, but without specifying the memory
  * transaction attributes to be used.
  */
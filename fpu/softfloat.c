@@ -88,6 +88,9 @@ this code that are retained.
 
 /* We only need stdlib for abort() */
 #include <stdlib.h>
+/* and float.h and math.h for the host FPU fast path */
+#include <float.h>
+#include <math.h>
 
 /*----------------------------------------------------------------------------
 | Primitive arithmetic functions, including multi-word arithmetic, and
@@ -106,6 +109,85 @@ this code that are retained.
 *----------------------------------------------------------------------------*/
 #include "softfloat-specialize.h"
 
+/*----------------------------------------------------------------------------
+| Host FPU fast path.  When the host evaluates `float' and `double' operations
+| in their own precision, it rounds them exactly as the IEC/IEEE Standard
+| requires, so in round-to-nearest-even mode and with zero or normal inputs
+| the host gives the same result as the code below.  What the host does not
+| give is the exception flags, so the fast path is only taken when the only
+| flag that can be raised is inexact and the caller does not need it: either
+| the target ignores it or it is already set.  Results that may have
+| overflowed or underflowed go through softfloat to get their flags right.
+*----------------------------------------------------------------------------*/
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define USE_HOST_FPU 1
+#else
+#define USE_HOST_FPU 0
+#endif
+
+static inline flag can_use_host_fpu(float_status *status)
+{
+    return USE_HOST_FPU &&
+           status->float_rounding_mode == float_round_nearest_even &&
+           (status->ignore_inexact ||
+            (status->float_exception_flags & float_flag_inexact));
+}
+
+static inline float float32_to_host(float32 a)
+{
+    union {
+        uint32_t i;
+        float f;
+    } u;
+
+    u.i = float32_val(a);
+    return u.f;
+}
+
+static inline float32 float32_from_host(float f)
+{
+    union {
+        uint32_t i;
+        float f;
+    } u;
+
+    u.f = f;
+    return make_float32(u.i);
+}
+
+static inline double float64_to_host(float64 a)
+{
+    union {
+        uint64_t i;
+        double d;
+    } u;
+
+    u.i = float64_val(a);
+    return u.d;
+}
+
+static inline float64 float64_from_host(double d)
+{
+    union {
+        uint64_t i;
+        double d;
+    } u;
+
+    u.d = d;
+    return make_float64(u.i);
+}
+
+/* Neither overflowed nor tiny, so no flag other than inexact was raised */
+static inline flag float32_host_result_ok(float r)
+{
+    return fabsf(r) > FLT_MIN && fabsf(r) <= FLT_MAX;
+}
+
+static inline flag float64_host_result_ok(double r)
+{
+    return fabs(r) > DBL_MIN && fabs(r) <= DBL_MAX;
+}
+
 /*----------------------------------------------------------------------------
 | Returns the fraction bits of the half-precision floating-point value `a'.
 *----------------------------------------------------------------------------*/
@@ -2162,6 +2244,17 @@ static float32 subFloat32Sigs(float32 a, float32 b, flag zSign,
 float32 float32_add(float32 a, float32 b, float_status *status)
 {
     flag aSign, bSign;
+
+    if (can_use_host_fpu(status) &&
+        float32_is_zero_or_normal(a) && float32_is_zero_or_normal(b)) {
+        float r = float32_to_host(a) + float32_to_host(b);
+
+        /* A zero result from zero or normal inputs is exact */
+        if (r == 0 || float32_host_result_ok(r)) {
+            return float32_from_host(r);
+        }
+    }
+
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
 
@@ -2185,6 +2278,17 @@ float32 float32_add(float32 a, float32 b, float_status *status)
 float32 float32_sub(float32 a, float32 b, float_status *status)
 {
     flag aSign, bSign;
+
+    if (can_use_host_fpu(status) &&
+        float32_is_zero_or_normal(a) && float32_is_zero_or_normal(b)) {
+        float r = float32_to_host(a) - float32_to_host(b);
+
+        /* A zero result from zero or normal inputs is exact */
+        if (r == 0 || float32_host_result_ok(r)) {
+            return float32_from_host(r);
+        }
+    }
+
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
 
@@ -2213,6 +2317,16 @@ float32 float32_mul(float32 a, float32 b, float_status *status)
     uint64_t zSig64;
     uint32_t zSig;
 
+    if (can_use_host_fpu(status) &&
+        float32_is_zero_or_normal(a) && float32_is_zero_or_normal(b)) {
+        float r = float32_to_host(a) * float32_to_host(b);
+
+        if (float32_is_zero(a) || float32_is_zero(b) ||
+            float32_host_result_ok(r)) {
+            return float32_from_host(r);
+        }
+    }
+
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
 
@@ -2275,6 +2389,16 @@ float32 float32_div(float32 a, float32 b, float_status *status)
     flag aSign, bSign, zSign;
     int_fast16_t aExp, bExp, zExp;
     uint32_t aSig, bSig, zSig;
+
+    if (can_use_host_fpu(status) &&
+        float32_is_zero_or_normal(a) && float32_is_normal(b)) {
+        float r = float32_to_host(a) / float32_to_host(b);
+
+        if (float32_is_zero(a) || float32_host_result_ok(r)) {
+            return float32_from_host(r);
+        }
+    }
+
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
 
@@ -2674,6 +2798,13 @@ float32 float32_sqrt(float32 a, float_status *status)
     int_fast16_t aExp, zExp;
     uint32_t aSig, zSig;
     uint64_t rem, term;
+
+    if (can_use_host_fpu(status) &&
+        (float32_is_zero(a) || (float32_is_normal(a) && !float32_is_neg(a)))) {
+        /* The square root of a normal number is normal */
+        return float32_from_host(sqrtf(float32_to_host(a)));
+    }
+
     a = float32_squash_input_denormal(a, status);
 
     aSig = extractFloat32Frac( a );
@@ -3948,6 +4079,17 @@ static float64 subFloat64Sigs(float64 a, float64 b, flag zSign,
 float64 float64_add(float64 a, float64 b, float_status *status)
 {
     flag aSign, bSign;
+
+    if (can_use_host_fpu(status) &&
+        float64_is_zero_or_normal(a) && float64_is_zero_or_normal(b)) {
+        double r = float64_to_host(a) + float64_to_host(b);
+
+        /* A zero result from zero or normal inputs is exact */
+        if (r == 0 || float64_host_result_ok(r)) {
+            return float64_from_host(r);
+        }
+    }
+
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
 
@@ -3971,6 +4113,17 @@ float64 float64_add(float64 a, float64 b, float_status *status)
 float64 float64_sub(float64 a, float64 b, float_status *status)
 {
     flag aSign, bSign;
+
+    if (can_use_host_fpu(status) &&
+        float64_is_zero_or_normal(a) && float64_is_zero_or_normal(b)) {
+        double r = float64_to_host(a) - float64_to_host(b);
+
+        /* A zero result from zero or normal inputs is exact */
+        if (r == 0 || float64_host_result_ok(r)) {
+            return float64_from_host(r);
+        }
+    }
+
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
 
@@ -3997,6 +4150,16 @@ float64 float64_mul(float64 a, float64 b, float_status *status)
     int_fast16_t aExp, bExp, zExp;
     uint64_t aSig, bSig, zSig0, zSig1;
 
+    if (can_use_host_fpu(status) &&
+        float64_is_zero_or_normal(a) && float64_is_zero_or_normal(b)) {
+        double r = float64_to_host(a) * float64_to_host(b);
+
+        if (float64_is_zero(a) || float64_is_zero(b) ||
+            float64_host_result_ok(r)) {
+            return float64_from_host(r);
+        }
+    }
+
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
 
@@ -4061,6 +4224,16 @@ float64 float64_div(float64 a, float64 b, float_status *status)
     uint64_t aSig, bSig, zSig;
     uint64_t rem0, rem1;
     uint64_t term0, term1;
+
+    if (can_use_host_fpu(status) &&
+        float64_is_zero_or_normal(a) && float64_is_normal(b)) {
+        double r = float64_to_host(a) / float64_to_host(b);
+
+        if (float64_is_zero(a) || float64_host_result_ok(r)) {
+            return float64_from_host(r);
+        }
+    }
+
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
 
@@ -4473,6 +4646,14 @@ float64 float64_sqrt(float64 a, float_status *status)
     int_fast16_t aExp, zExp;
     uint64_t aSig, zSig, doubleZSig;
     uint64_t rem0, rem1, term0, term1;
+
+    if (can_use_host_fpu(status) &&
+        (float64_is_zero(a) ||
+         (float64_is_normal(a) && !float64_is_neg(a)))) {
+        /* The square root of a normal number is normal */
+        return float64_from_host(sqrt(float64_to_host(a)));
+    }
+
     a = float64_squash_input_denormal(a, status);
 
     aSig = extractFloat64Frac( a );
@@ -244,6 +244,22 @@ STEXI
 @item info tlb
 @findex tlb
 Show virtual to physical memory mappings.
+ETEXI
+
+    {
+        .name       = "tlb-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show softmmu TLB miss and flush statistics",
+        .mhandler.cmd = hmp_info_tlb_stats,
+    },
+
+STEXI
+@item info tlb-stats
+@findex tlb-stats
+Show, for each CPU, how many softmmu TLB misses and flushes there were
+and which areas mapped by large pages are being tracked.  TLB hits are
+not counted, as they never leave the generated code.
 ETEXI
 
 #if defined(TARGET_I386)
@@ -288,6 +304,22 @@ STEXI
 @item info jit
 @findex jit
 Show dynamic compiler info.
+ETEXI
+
+    {
+        .name       = "jit-profile",
+        .args_type  = "count:i?",
+        .params     = "[count]",
+        .help       = "show the translation blocks that ran the most "
+                      "guest instructions",
+        .mhandler.cmd = hmp_info_jit_profile,
+    },
+
+STEXI
+@item info jit-profile [@var{count}]
+@findex jit-profile
+Show the @var{count} translation blocks (20 by default) that ran the most
+guest instructions since @code{jit-profile on}, with their execution counts.
 ETEXI
 
     {
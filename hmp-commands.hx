@@ -371,6 +371,23 @@ STEXI
 @findex singlestep
 Run the emulation in single step mode.
 If called with option off, the emulation returns to normal mode.
+ETEXI
+
+    {
+        .name       = "jit-profile",
+        .args_type  = "option:s?",
+        .params     = "[on|off]",
+        .help       = "count the executions of each translation block",
+        .mhandler.cmd = hmp_jit_profile,
+    },
+
+STEXI
+@item jit-profile [off]
+@findex jit-profile
+Flush the translated code and translate it again with an execution counter
+in each translation block, see @code{info jit-profile}.  If called with
+option off, code translated from then on is not counted.  This only
+measures; the translated code itself stays the same.
 ETEXI
 
     {
@@ -31,6 +31,7 @@
 #include "hw/devices.h"
 #include "hw/boards.h"
 #include "sysemu/block-backend.h"
+#include "sysemu/char.h"
 #include "hw/char/serial.h"
 #include "exec/address-spaces.h"
 #include "hw/ssi.h"
@@ -52,6 +53,7 @@
 #define TIMER_BASEADDR 0x83c00000
 #define UARTLITE_BASEADDR 0x84000000
 #define SPRITE_ENGINE_BASEADDR 0xA0000000
+#define SPRITE_ENGINE_DMA_BASEADDR 0xA0010000
 #define SPRITE_ENGINE_CONTROLLER_1 0xB0000000
 #define SPRITE_ENGINE_CONTROLLER_2 0xB0000004
 #define SPRITE_ENGINE_CONTROLLER_3 0xB0000008
@@ -62,13 +64,38 @@
 #define TIMER_IRQ           2
 #define AXIENET_IRQ         3
 #define UARTLITE_IRQ        4
+#define SPRITE_ENGINE_DMA_IRQ 5
+#define SPRITE_ENGINE_CONTROLLER_IRQ 6
+#define SPRITE_ENGINE_IRQ   7
+
+#define NUM_CONTROLLERS 4
+#define CONTROLLER_BASE_PORT 1986
+
+/*
+ * The renderer, vsync and controller endpoints default to TCP on
+ * localhost.  Creating a chardev with one of these ids, e.g.
+ * "-chardev socket,id=se-render,path=/tmp/render.sock", routes that
+ * device through the chardev instead.  Controller i uses "se-ctrl<i>".
+ */
+#define CHARDEV_RENDER "se-render"
+#define CHARDEV_VSYNC "se-vsync"
+#define CHARDEV_CONTROLLER "se-ctrl%d"
+
+static void sprite_engine_set_chardev(DeviceState *dev, const char *id)
+{
+    CharDriverState *chr = qemu_chr_find(id);
+
+    if (chr) {
+        qdev_prop_set_chr(dev, "chardev", chr);
+    }
+}
 
 static void
 sprite_engine_init(MachineState *machine)
 {
     ram_addr_t ram_size = machine->ram_size;
     MemoryRegion *address_space_mem = get_system_memory();
-    DeviceState *dev;
+    DeviceState *dev, *engine;
     MicroBlazeCPU *cpu;
     DriveInfo *dinfo;
     int i;
@@ -109,7 +136,9 @@ sprite_engine_init(MachineState *machine)
 
 
     dev = qdev_create(NULL, "xlnx.xps-intc");
-    qdev_prop_set_uint32(dev, "kind-of-intr", 1 << TIMER_IRQ);
+    qdev_prop_set_uint32(dev, "kind-of-intr",
+                         1 << TIMER_IRQ | 1 << SPRITE_ENGINE_CONTROLLER_IRQ |
+                         1 << SPRITE_ENGINE_IRQ);
     qdev_init_nofail(dev);
     sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, INTC_BASEADDR);
     sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0,
@@ -125,31 +154,42 @@ sprite_engine_init(MachineState *machine)
     // Create the vsync timer, and connect it to TIMER_IRQ
     dev = qdev_create(NULL, "sprite-engine.vsync");
     qdev_prop_set_uint32(dev, "clock-frequency", 60000);
+    sprite_engine_set_chardev(dev, CHARDEV_VSYNC);
     qdev_init_nofail(dev);
     sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0, irq[TIMER_IRQ]);
 
     /* sprite engine init */
-    dev = qdev_create(NULL, "sprite-engine");
-    qdev_init_nofail(dev);
-    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, SPRITE_ENGINE_BASEADDR);
-
-    /* sprite engine controllers init */
-    dev = qdev_create(NULL, "sprite-engine-controller");
-    qdev_prop_set_uint32(dev, "port", 1986);
-    qdev_init_nofail(dev);
-    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, SPRITE_ENGINE_CONTROLLER_1);
-    dev = qdev_create(NULL, "sprite-engine-controller");
-    qdev_prop_set_uint32(dev, "port", 1987);
-    qdev_init_nofail(dev);
-    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, SPRITE_ENGINE_CONTROLLER_2);
-    dev = qdev_create(NULL, "sprite-engine-controller");
-    qdev_prop_set_uint32(dev, "port", 1988);
-    qdev_init_nofail(dev);
-    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, SPRITE_ENGINE_CONTROLLER_3);
-    dev = qdev_create(NULL, "sprite-engine-controller");
-    qdev_prop_set_uint32(dev, "port", 1989);
+    engine = qdev_create(NULL, "sprite-engine");
+    sprite_engine_set_chardev(engine, CHARDEV_RENDER);
+    qdev_init_nofail(engine);
+    sysbus_mmio_map(SYS_BUS_DEVICE(engine), 0, SPRITE_ENGINE_BASEADDR);
+    sysbus_connect_irq(SYS_BUS_DEVICE(engine), 0, irq[SPRITE_ENGINE_IRQ]);
+
+    /* bulk upload DMA, feeding the sprite engine from RAM */
+    dev = qdev_create(NULL, "sprite-engine.dma");
+#ifdef TARGET_WORDS_BIGENDIAN
+    qdev_prop_set_bit(dev, "big-endian", true);
+#endif
+    object_property_set_link(OBJECT(dev), OBJECT(engine), "sprite-engine",
+                             &error_abort);
     qdev_init_nofail(dev);
-    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, SPRITE_ENGINE_CONTROLLER_4);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, SPRITE_ENGINE_DMA_BASEADDR);
+    sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0, irq[SPRITE_ENGINE_DMA_IRQ]);
+
+    /* sprite engine controllers init, all sharing one edge triggered irq */
+    for (i = 0; i < NUM_CONTROLLERS; i++) {
+        char *id = g_strdup_printf(CHARDEV_CONTROLLER, i);
+
+        dev = qdev_create(NULL, "sprite-engine-controller");
+        qdev_prop_set_uint32(dev, "port", CONTROLLER_BASE_PORT + i);
+        sprite_engine_set_chardev(dev, id);
+        g_free(id);
+        qdev_init_nofail(dev);
+        sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0,
+                        SPRITE_ENGINE_CONTROLLER_1 + i * 4);
+        sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0,
+                           irq[SPRITE_ENGINE_CONTROLLER_IRQ]);
+    }
 
     /* setup PVR to match kernel settings */
     cpu->env.pvr.regs[4] = 0xc56b8000;
@@ -26,125 +26,558 @@
 #include <sys/socket.h>
 #include "hw/sysbus.h"
 #include "hw/ptimer.h"
+#include "qemu/bitmap.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
+#include "qemu/sockets.h"
+#include "ui/console.h"
+#include "trace.h"
 
+#include "hw/sprite-engine/sprite_engine.h"
+#include "hw/sprite-engine/sprite_engine_chr.h"
 #include "hw/sprite-engine/sprite_engine_commands.h"
+#include "hw/sprite-engine/sprite_engine_render.h"
+#include "hw/sprite-engine/sprite_engine_ring.h"
 #include "hw/sprite-engine/sprite_engine_vsync_counter.h"
+#include "hw/sprite-engine/sprite_engine_wire.h"
 
-#define TYPE_SPRITE_ENGINE "sprite-engine"
-#define SPRITE_ENGINE(obj) \
-    OBJECT_CHECK(struct engineblock, (obj), TYPE_SPRITE_ENGINE)
-
-// MIN and MAX are defined inclusive
-#define SE_REGION_MIN   (0x00000000)
-#define SE_OAM_MIN      (SE_REGION_MIN)
-#define SE_OAM_MAX      (SE_REGION_MIN + 0x1EC)
-#define SE_PRIORITY_CTL (SE_REGION_MIN + 0x1FC)
-#define SE_INST_MIN     (SE_REGION_MIN + 0x200)
-#define SE_INST_MAX     (SE_REGION_MIN + 0x3FC)
-#define SE_CRAM_MIN     (SE_REGION_MIN + 0x400)
-#define SE_CRAM_MAX     (SE_REGION_MIN + 0x4FC)
-#define SE_VRAM_MIN     (SE_REGION_MIN + 0x800)
-#define SE_VRAM_MAX     (SE_REGION_MIN + 0x803)
-#define SE_REGION_MAX   SE_VRAM_MAX
+// Size of a compact wire packet; a full packet is sent before the vsync
+#define SE_WIRE_PACKET_SIZE (64 * 1024)
+
+// VRAM shadow, two 4-bit pixels per byte
+#define SE_VRAM_CHUNKS      512
+#define SE_VRAM_DIM         64
+#define SE_VRAM_CHUNK_BYTES (SE_VRAM_DIM * SE_VRAM_DIM / 2)
+#define SE_VRAM_BYTES       (SE_VRAM_CHUNKS * SE_VRAM_CHUNK_BYTES)
+
+typedef struct SEFrame {
+    uint32_t oam[SE_OAM_WORDS];
+    uint32_t inst[SE_INST_WORDS];
+    uint32_t cram[SE_CRAM_WORDS];
+    uint32_t priority;
+} SEFrame;
 
 struct engineblock
 {
     SysBusDevice parent_obj;
 
     MemoryRegion mmio;
+    qemu_irq irq;
+    uint32_t port;
     int sockd;
-    uint32_t oam_vals[(SE_OAM_MAX - SE_OAM_MIN) >> 2];
-    uint32_t inst_oam_vals[(SE_INST_MAX - SE_INST_MIN) >> 2];
+
+    // Character device used instead of the TCP connection when set
+    CharDriverState *chr;
+    SEChrOut out;
+
+    // "tcp" (the default) or "internal" for the built in renderer
+    char *backend;
+    bool use_render;
+    SERenderer render;
+    QemuConsole *con;
+
+    // Shared memory command ring, used instead of sockd when ring_path is set
+    char *ring_path;
+    uint32_t ring_size;
+    bool use_ring;
+    SERing ring;
+    // Polls the ring from the main loop while commands are held back
+    QEMUTimer *ring_timer;
+    Notifier vsync_notifier;
+
+    // Compact wire format on sockd or chr, packets are sent once per frame
+    bool compact;
+    SEWireEncoder wire;
+
+    // Legacy commands queued between batch_begin and batch_end
+    GByteArray *batch;
+
+    // Guest writes land in back.  With double_buffer set they are only
+    // handed to the renderer, as the difference against front, when the
+    // frame is committed through SE_COMMIT or at the next vsync.
+    bool double_buffer;
+    bool dirty;
+    SEFrame back;
+    SEFrame front;
+
+    // Copy of VRAM, only used to send it all again after a migration.
+    // vram_touched has a bit for every chunk the renderer may have drawn.
+    uint8_t *vram;
+    unsigned long *vram_touched;
+    // Next chunk to send again, retried from resend_timer while the
+    // output is backed up
+    int resend_chunk;
+    QEMUTimer *resend_timer;
 };
 
 static uint64_t
 sprite_engine_read(void *opaque, hwaddr addr, unsigned int size)
 {
     struct engineblock *engine = opaque;
-    // Only support oam reads for now
+
     if (addr >= SE_OAM_MIN && addr <= SE_OAM_MAX) {
-        return engine->oam_vals[(addr - SE_OAM_MIN) >> 2];
+        return engine->back.oam[(addr - SE_OAM_MIN) >> 2];
+    } else if (addr == SE_PRIORITY_CTL) {
+        return engine->back.priority;
+    } else if (addr == SE_STATUS) {
+        return engine->use_ring && se_ring_busy(&engine->ring) ?
+               SE_STATUS_BUSY : 0;
     } else if (addr >= SE_INST_MIN && addr <= SE_INST_MAX) {
-        return engine->inst_oam_vals[(addr - SE_INST_MIN) >> 2];
+        return engine->back.inst[(addr - SE_INST_MIN) >> 2];
+    } else if (addr >= SE_CRAM_MIN && addr <= SE_CRAM_MAX) {
+        return engine->back.cram[(addr - SE_CRAM_MIN) >> 2];
     } else {
         return 0;
     }
 }
 
 static void
-sprite_engine_write(void *opaque, hwaddr addr,
-            uint64_t val64, unsigned int size)
+sprite_engine_output(struct engineblock *engine, const void *buf, size_t len)
+{
+    if (engine->chr) {
+        se_chr_out_write(&engine->out, buf, len);
+    } else if (engine->sockd != -1) {
+        ssize_t rv = send_all(engine->sockd, buf, len);
+        if (rv != len) {
+            trace_sprite_engine_send_failed(len, rv);
+        }
+    }
+}
+
+static void
+sprite_engine_send_packet(struct engineblock *engine)
+{
+    size_t len = se_wire_encoder_finish(&engine->wire);
+
+    if (len) {
+        sprite_engine_output(engine, engine->wire.buf, len);
+    }
+}
+
+// How often a full ring is checked for room
+#define SE_RING_POLL_NS     (1 * SCALE_MS)
+
+static void sprite_engine_ring_poll(void *opaque)
 {
-    bool skip_write = false;
-    union SECommand cmd;
     struct engineblock *engine = opaque;
 
-    int log = open("/tmp/se-write-qemu.log", O_CREAT | O_RDWR | O_APPEND, 0777);
+    if (se_ring_drain(&engine->ring)) {
+        qemu_irq_pulse(engine->irq);
+    } else {
+        timer_mod(engine->ring_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + SE_RING_POLL_NS);
+    }
+}
+
+static void sprite_engine_ring_push(struct engineblock *engine,
+                                    union SECommand *cmd)
+{
+    if (!se_ring_push(&engine->ring, cmd)) {
+        trace_sprite_engine_ring_dropped(engine->ring.dropped);
+    }
+    if (se_ring_busy(&engine->ring) &&
+        !timer_pending(engine->ring_timer)) {
+        timer_mod(engine->ring_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + SE_RING_POLL_NS);
+    }
+}
+
+static void
+sprite_engine_emit(struct engineblock *engine, union SECommand *cmd)
+{
+    if (engine->use_render) {
+        se_render_apply(&engine->render, cmd);
+    } else if (engine->use_ring) {
+        sprite_engine_ring_push(engine, cmd);
+    } else if (engine->compact) {
+        uint32_t count = get_sprite_engine_vsync_count();
+        if (!se_wire_encode(&engine->wire, cmd, count)) {
+            sprite_engine_send_packet(engine);
+            se_wire_encode(&engine->wire, cmd, count);
+        }
+    } else if (engine->batch) {
+        g_byte_array_append(engine->batch, (guint8 *) cmd,
+                            sizeof(union SECommand));
+    } else {
+        sprite_engine_output(engine, cmd, sizeof(union SECommand));
+    }
+}
+
+static void
+sprite_engine_flush(struct engineblock *engine)
+{
+    if (engine->use_ring) {
+        // The poll timer raises the interrupt once the backlog is gone
+        se_ring_drain(&engine->ring);
+    } else if (engine->compact) {
+        sprite_engine_send_packet(engine);
+    }
+}
+
+static void
+sprite_engine_emit_oam(struct engineblock *engine, const SEFrame *f,
+                       int word)
+{
+    union SECommand cmd;
 
     memset(&cmd, 0, sizeof(union SECommand));
+    fillUpdateOAM((SE_OAM_MIN >> 2) + word, f->oam[word], &cmd.update_oam);
+    cmd.update_oam.vsync_count = get_sprite_engine_vsync_count();
+    sprite_engine_emit(engine, &cmd);
+}
+
+static void
+sprite_engine_emit_priority(struct engineblock *engine, const SEFrame *f)
+{
+    union SECommand cmd;
+
+    memset(&cmd, 0, sizeof(union SECommand));
+    fillPriorityControl(f->priority, &cmd.set_priority_control);
+    sprite_engine_emit(engine, &cmd);
+}
+
+// @word is the even word of an instance, the odd one holds its oam part
+static void
+sprite_engine_emit_inst(struct engineblock *engine, const SEFrame *f,
+                        int word)
+{
+    uint64_t val = (uint64_t) f->inst[word + 1] |
+                   ((uint64_t) f->inst[word] << 32);
+    union SECommand cmd;
+
+    memset(&cmd, 0, sizeof(union SECommand));
+    fillUpdateInstOAM((SE_INST_MIN >> 2) + word, val, &cmd.update_oam);
+    sprite_engine_emit(engine, &cmd);
+}
+
+static void
+sprite_engine_emit_cram(struct engineblock *engine, const SEFrame *f,
+                        int word)
+{
+    union SECommand cmd;
+
+    memset(&cmd, 0, sizeof(union SECommand));
+    fillUpdateCRAM((SE_CRAM_MIN >> 2) + word, f->cram[word], &cmd.update_cram);
+    sprite_engine_emit(engine, &cmd);
+}
+
+/*
+ * Queue legacy commands until sprite_engine_batch_end() so that they go
+ * out with a single send.  Ring and compact output is batched already and
+ * only needs the flush at the end.  Returns true if a batch was started.
+ */
+static bool
+sprite_engine_batch_begin(struct engineblock *engine, size_t count)
+{
+    if (engine->use_render || engine->use_ring || engine->compact ||
+        engine->batch) {
+        return false;
+    }
+    engine->batch = g_byte_array_sized_new(count * sizeof(union SECommand));
+    return true;
+}
+
+static void
+sprite_engine_batch_end(struct engineblock *engine, bool started)
+{
+    if (started) {
+        if (engine->batch->len) {
+            sprite_engine_output(engine, engine->batch->data,
+                                 engine->batch->len);
+        }
+        g_byte_array_free(engine->batch, true);
+        engine->batch = NULL;
+    } else if (!engine->batch) {
+        sprite_engine_flush(engine);
+    }
+}
+
+/*
+ * Make the back buffer the displayed frame: send a command for every
+ * register that differs from the front buffer, then copy it over.
+ */
+static void
+sprite_engine_commit(struct engineblock *engine)
+{
+    SEFrame *back = &engine->back;
+    SEFrame *front = &engine->front;
+    unsigned changed = 0;
+    bool started;
+    int i;
+
+    if (!engine->dirty) {
+        return;
+    }
+
+    started = sprite_engine_batch_begin(engine, SE_OAM_WORDS +
+                                        SE_INST_WORDS / 2 + SE_CRAM_WORDS + 1);
+    for (i = 0; i < SE_OAM_WORDS; i++) {
+        if (back->oam[i] != front->oam[i]) {
+            sprite_engine_emit_oam(engine, back, i);
+            changed++;
+        }
+    }
+    if (back->priority != front->priority) {
+        sprite_engine_emit_priority(engine, back);
+        changed++;
+    }
+    for (i = 0; i < SE_INST_WORDS; i += 2) {
+        if (back->inst[i] != front->inst[i] ||
+            back->inst[i + 1] != front->inst[i + 1]) {
+            sprite_engine_emit_inst(engine, back, i);
+            changed++;
+        }
+    }
+    for (i = 0; i < SE_CRAM_WORDS; i++) {
+        if (back->cram[i] != front->cram[i]) {
+            sprite_engine_emit_cram(engine, back, i);
+            changed++;
+        }
+    }
+    trace_sprite_engine_commit(get_sprite_engine_vsync_count(), changed);
+
+    *front = *back;
+    engine->dirty = false;
+    sprite_engine_batch_end(engine, started);
+}
+
+static void
+sprite_engine_vram_store(struct engineblock *engine,
+                         const struct SECommandUpdateVRAM *v)
+{
+    uint8_t *p = engine->vram + v->chunk * SE_VRAM_CHUNK_BYTES +
+                 (v->pixel_y * SE_VRAM_DIM + v->pixel_x) / 2;
+
+    if (v->pixel_x & 1) {
+        *p = (*p & 0x0f) | (v->p_data << 4);
+    } else {
+        *p = (*p & 0xf0) | v->p_data;
+    }
+    set_bit(v->chunk, engine->vram_touched);
+}
+
+// How often the VRAM resend checks whether the output has room again
+#define SE_RESEND_POLL_NS   (10 * SCALE_MS)
+
+/*
+ * Room for another chunk of VRAM on the way to the renderer.  A chunk is
+ * 4096 commands, so the chardev queue or the ring backlog would overflow
+ * and drop whole chunks if they were all pushed at once.
+ */
+static bool
+sprite_engine_output_ready(struct engineblock *engine)
+{
+    if (engine->use_ring) {
+        return !se_ring_busy(&engine->ring);
+    } else if (engine->chr) {
+        return se_chr_out_pending(&engine->out) <= SE_CHR_QUEUE_MAX / 2;
+    }
+    // The internal renderer and the blocking socket take everything
+    return true;
+}
+
+static void
+sprite_engine_resend_chunk(struct engineblock *engine, int chunk)
+{
+    const uint8_t *p = engine->vram + chunk * SE_VRAM_CHUNK_BYTES;
+    union SECommand cmd;
+    bool started;
+    int x, y;
+
+    started = sprite_engine_batch_begin(engine, SE_VRAM_DIM * SE_VRAM_DIM);
+    for (y = 0; y < SE_VRAM_DIM; y++) {
+        for (x = 0; x < SE_VRAM_DIM; x++) {
+            uint8_t pair = p[(y * SE_VRAM_DIM + x) / 2];
+            uint32_t pixel = x & 1 ? pair >> 4 : pair & 0xf;
+
+            fillUpdateVRAM(0, (chunk << 23) | (y << 17) | (x << 11) | pixel,
+                           &cmd.update_vram);
+            sprite_engine_emit(engine, &cmd);
+        }
+    }
+    sprite_engine_batch_end(engine, started);
+}
+
+/*
+ * Send the VRAM chunks from resend_chunk on, one batch each, for as long
+ * as the output keeps up; the rest is picked up again from resend_timer.
+ * A chunk the guest writes to in the meantime still goes out whole, with
+ * the new pixels, so the renderer ends up with the same picture.
+ */
+static void
+sprite_engine_resend_vram(void *opaque)
+{
+    struct engineblock *engine = opaque;
+
+    for (; engine->resend_chunk < SE_VRAM_CHUNKS; engine->resend_chunk++) {
+        int chunk = engine->resend_chunk;
+
+        if (!test_bit(chunk, engine->vram_touched) &&
+            buffer_is_zero(engine->vram + chunk * SE_VRAM_CHUNK_BYTES,
+                           SE_VRAM_CHUNK_BYTES)) {
+            continue;
+        }
+        if (!sprite_engine_output_ready(engine)) {
+            timer_mod(engine->resend_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                      SE_RESEND_POLL_NS);
+            return;
+        }
+        set_bit(chunk, engine->vram_touched);
+        sprite_engine_resend_chunk(engine, chunk);
+    }
+}
+
+/*
+ * Send the complete state to the renderer again, after loading a snapshot
+ * or an incoming migration.  A renderer that was running before loadvm
+ * still shows the old picture, so every chunk drawn since realize goes
+ * out together with those that are set in the loaded state.  Registers
+ * go first in a single batch, VRAM follows a chunk at a time.
+ */
+static void
+sprite_engine_resend(struct engineblock *engine)
+{
+    // With double buffering the renderer shows front, back is pending
+    const SEFrame *f = engine->double_buffer ? &engine->front : &engine->back;
+    bool started;
+    int i;
+
+    if (engine->compact) {
+        // Start over with a keyframe, the peer may have lost the history
+        se_wire_encoder_reset(&engine->wire);
+    }
+    started = sprite_engine_batch_begin(engine, SE_OAM_WORDS +
+                                        SE_INST_WORDS / 2 + SE_CRAM_WORDS + 1);
+
+    for (i = 0; i < SE_OAM_WORDS; i++) {
+        sprite_engine_emit_oam(engine, f, i);
+    }
+    sprite_engine_emit_priority(engine, f);
+    for (i = 0; i < SE_INST_WORDS; i += 2) {
+        sprite_engine_emit_inst(engine, f, i);
+    }
+    for (i = 0; i < SE_CRAM_WORDS; i++) {
+        sprite_engine_emit_cram(engine, f, i);
+    }
+
+    sprite_engine_batch_end(engine, started);
+
+    timer_del(engine->resend_timer);
+    engine->resend_chunk = 0;
+    sprite_engine_resend_vram(engine);
+}
+
+static void
+sprite_engine_vsync(Notifier *notifier, void *data)
+{
+    struct engineblock *engine = container_of(notifier, struct engineblock,
+                                              vsync_notifier);
+
+    if (engine->double_buffer) {
+        sprite_engine_commit(engine);
+    }
+    // Hand the whole frame's worth of commands over in one go
+    sprite_engine_flush(engine);
+}
+
+static void
+sprite_engine_do_write(struct engineblock *engine, hwaddr addr,
+                       uint64_t val64)
+{
+    bool immediate = !engine->double_buffer;
+    uint32_t val = (uint32_t) val64;
+    SEFrame *back = &engine->back;
 
     if (addr >= SE_OAM_MIN && addr <= SE_OAM_MAX) {
         // OAM write
-        dprintf(log, "sprite_engine_write (OAM): at addr %llx  val %llu\n", addr, val64);
-        uint32_t count = get_sprite_engine_vsync_count();
-        int oamRegIndex = addr >> 2;
-        uint32_t val = (uint32_t) val64;
-        fillUpdateOAM(oamRegIndex, val, &cmd.update_oam);
-        debugUpdateOAM(log, &cmd.update_oam);
-        cmd.update_oam.vsync_count = count;
-        // Save oam val
-        engine->oam_vals[(addr - SE_OAM_MIN) >> 2] = val;
+        int word = (addr - SE_OAM_MIN) >> 2;
+        back->oam[word] = val;
+        trace_sprite_engine_write_oam(addr >> 2, val,
+                                      get_sprite_engine_vsync_count());
+        if (immediate) {
+            sprite_engine_emit_oam(engine, back, word);
+        }
     } else if (addr == SE_PRIORITY_CTL) {
         // Priority write
-        dprintf(log, "sprite_engine_write (PRIORITY): at addr %llx  val %llu\n", addr, val64);
-        uint8_t val = (uint8_t) val64;
-        fillPriorityControl(val, &cmd.set_priority_control);
-        debugPriorityControl(log, &cmd.set_priority_control);
+        back->priority = (uint8_t) val64;
+        trace_sprite_engine_write_priority(back->priority & 1);
+        if (immediate) {
+            sprite_engine_emit_priority(engine, back);
+        }
     } else if (addr >= SE_INST_MIN && addr <= SE_INST_MAX) {
         // Instance write
-        dprintf(log, "sprite_engine_write (INSTANCE): at addr %llx  val %llu\n", addr, val64);
-        int oamRegIndex = addr >> 2;
+        int word = (addr - SE_INST_MIN) >> 2;
 
         // We skip writing if this is the oam part,
         //  We will flush once the object part has been written too;
-        skip_write = (addr % 8 != 0);
-        if (!skip_write) {
-            uint64_t val = (((uint64_t) engine->inst_oam_vals[(addr - SE_INST_MIN + 0x4) >> 2])) | (((uint64_t) val64 << 32));
-            fillUpdateInstOAM(oamRegIndex, val, &cmd.update_oam);
-            debugUpdateOAM(log, &cmd.update_oam);
-        }
-        // Save inst val
-        engine->inst_oam_vals[(addr - SE_INST_MIN) >> 2] = (uint32_t) val64;
+        bool flush = immediate && !(word & 1);
+        back->inst[word] = val;
+        trace_sprite_engine_write_inst(addr >> 2, val, flush);
+        if (flush) {
+            sprite_engine_emit_inst(engine, back, word);
+        }
     } else if (addr >= SE_CRAM_MIN && addr <= SE_CRAM_MAX) {
         // CRAM write
-        dprintf(log, "sprite_engine_write (CRAM): at addr %llx  val %llu\n", addr, val64);
-        int oamRegIndex = addr >> 2;
-        uint32_t val = (uint32_t) val64;
-        fillUpdateCRAM(oamRegIndex, val, &cmd.update_cram);
-        debugUpdateCRAM(log, &cmd.update_cram);
+        int word = (addr - SE_CRAM_MIN) >> 2;
+        back->cram[word] = val;
+        trace_sprite_engine_write_cram(addr >> 2, val);
+        if (immediate) {
+            sprite_engine_emit_cram(engine, back, word);
+        }
     } else if (addr >= SE_VRAM_MIN && addr <= SE_VRAM_MAX) {
-        // VRAM write
-        dprintf(log, "sprite_engine_write (VRAM): at addr %llx  val %llu\n", addr, val64);
-        int oamRegIndex = addr >> 2;
-        uint32_t val = (uint32_t) val64;
-        fillUpdateVRAM(oamRegIndex, val, &cmd.update_vram);
-        debugUpdateVRAM(log, &cmd.update_vram);
+        // VRAM is not double buffered, pixels go straight through
+        union SECommand cmd;
+
+        memset(&cmd, 0, sizeof(union SECommand));
+        fillUpdateVRAM(addr >> 2, val, &cmd.update_vram);
+        trace_sprite_engine_write_vram(cmd.update_vram.chunk,
+                                       cmd.update_vram.pixel_x,
+                                       cmd.update_vram.pixel_y,
+                                       cmd.update_vram.p_data);
+        sprite_engine_vram_store(engine, &cmd.update_vram);
+        sprite_engine_emit(engine, &cmd);
+        return;
+    } else if (addr == SE_COMMIT) {
+        // Any value commits, a no-op unless double buffering is enabled
+        sprite_engine_commit(engine);
+        return;
     } else {
         // Out of range. Ignore it?
-        dprintf(log, "sprite_engine_write (OUT_OF_RANGE): at addr %llx  val %llu\n", addr, val64);
-        close(log);
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "sprite_engine_write: bad offset 0x%" HWADDR_PRIx "\n",
+                      addr);
         return;
     }
-    if (!skip_write) {
-        size_t cmd_size = sizeof(union SECommand);
-        ssize_t rv = send(engine->sockd, &cmd, cmd_size, 0);
-        if (rv != cmd_size) {
-            dprintf(log, "sprite_engine_write send failed expected: %zd  observed: %zd\n", cmd_size, rv);
+    if (!immediate) {
+        engine->dirty = true;
+    }
+}
+
+static void
+sprite_engine_write(void *opaque, hwaddr addr,
+            uint64_t val64, unsigned int size)
+{
+    sprite_engine_do_write(opaque, addr, val64);
+}
+
+void sprite_engine_bulk_write(struct engineblock *engine, hwaddr addr,
+                              const uint32_t *vals, size_t count)
+{
+    bool started;
+    size_t i;
+
+    trace_sprite_engine_bulk_write(addr, count);
+    started = sprite_engine_batch_begin(engine, count);
+
+    for (i = 0; i < count; i++) {
+        sprite_engine_do_write(engine, addr, vals[i]);
+        if (addr < SE_VRAM_MIN || addr > SE_VRAM_MAX) {
+            addr += 4;
         }
     }
-    close(log);
+
+    sprite_engine_batch_end(engine, started);
 }
 
 static const MemoryRegionOps sprite_engine_ops = {
@@ -157,40 +590,163 @@ static const MemoryRegionOps sprite_engine_ops = {
     }
 };
 
-static void sprite_engine_realize(DeviceState *dev, Error **errp)
-{
-    struct engineblock *engine = SPRITE_ENGINE(dev);
-
-    memory_region_init_io(&engine->mmio, OBJECT(engine), &sprite_engine_ops, engine, "sprite-engine", 0x00002000);
-    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &engine->mmio);
-}
-
-static void sprite_engine_init(Object *obj)
+static void sprite_engine_connect(struct engineblock *engine)
 {
     struct sockaddr_in server;
-    struct engineblock *engine = SPRITE_ENGINE(obj);
-
-    int log = open("/tmp/se-init.log", O_CREAT | O_RDWR | O_APPEND, 0777);
 
+    engine->sockd = -1;
     int sockd = socket(PF_INET, SOCK_STREAM, 0);
     if (sockd == -1) {
-        dprintf(log, "sprite_engine_init: failed to create socket");
+        trace_sprite_engine_connect_failed(errno);
         return;
     }
 
     server.sin_addr.s_addr = inet_addr("127.0.0.1");
     server.sin_family = PF_INET;
-    server.sin_port = htons( 1985 );
+    server.sin_port = htons(engine->port);
     int rv = connect(sockd, (struct sockaddr*) &server, sizeof(struct sockaddr));
     if (rv != 0) {
-        dprintf(log, "sprite_engine_init: failed to connect\n");
+        trace_sprite_engine_connect_failed(errno);
+        close(sockd);
         return;
     }
     engine->sockd = sockd;
-    close(log);
 }
 
+static void sprite_engine_update_display(void *opaque)
+{
+    struct engineblock *engine = opaque;
+    DisplaySurface *surface = qemu_console_surface(engine->con);
+
+    if (!engine->render.dirty || surface_bits_per_pixel(surface) != 32) {
+        return;
+    }
+    se_render_frame(&engine->render, surface_data(surface),
+                    surface_stride(surface));
+    dpy_gfx_update(engine->con, 0, 0, SE_RENDER_WIDTH, SE_RENDER_HEIGHT);
+}
+
+static void sprite_engine_invalidate_display(void *opaque)
+{
+    struct engineblock *engine = opaque;
+
+    engine->render.dirty = true;
+}
+
+static const GraphicHwOps sprite_engine_gfx_ops = {
+    .invalidate = sprite_engine_invalidate_display,
+    .gfx_update = sprite_engine_update_display,
+};
+
+static void sprite_engine_realize(DeviceState *dev, Error **errp)
+{
+    struct engineblock *engine = SPRITE_ENGINE(dev);
+
+    memory_region_init_io(&engine->mmio, OBJECT(engine), &sprite_engine_ops, engine, "sprite-engine", 0x00002000);
+    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &engine->mmio);
+    sysbus_init_irq(SYS_BUS_DEVICE(dev), &engine->irq);
+
+    engine->vram = g_malloc0(SE_VRAM_BYTES);
+    engine->vram_touched = bitmap_new(SE_VRAM_CHUNKS);
+    engine->resend_chunk = SE_VRAM_CHUNKS;
+    engine->resend_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                        sprite_engine_resend_vram, engine);
+    engine->sockd = -1;
+    if (engine->backend && strcmp(engine->backend, "internal") == 0) {
+        if (engine->ring_path || engine->compact || engine->chr) {
+            error_setg(errp, "sprite-engine: 'ring', 'compact' and 'chardev' "
+                       "cannot be used with the internal backend");
+            return;
+        }
+        engine->use_render = true;
+        se_render_init(&engine->render);
+        engine->con = graphic_console_init(dev, 0, &sprite_engine_gfx_ops,
+                                           engine);
+        qemu_console_resize(engine->con, SE_RENDER_WIDTH, SE_RENDER_HEIGHT);
+    } else if (engine->backend && strcmp(engine->backend, "tcp") != 0) {
+        error_setg(errp, "sprite-engine: unknown backend '%s'",
+                   engine->backend);
+        return;
+    } else if (engine->ring_path) {
+        if (engine->chr) {
+            error_setg(errp, "sprite-engine: 'ring' and 'chardev' cannot be "
+                       "used together");
+            return;
+        }
+        if (se_ring_init(&engine->ring, engine->ring_path, engine->ring_size,
+                         sizeof(union SECommand), errp) < 0) {
+            return;
+        }
+        engine->use_ring = true;
+        engine->ring_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                          sprite_engine_ring_poll, engine);
+    } else {
+        if (engine->chr) {
+            se_chr_out_init(&engine->out, engine->chr);
+        } else {
+            sprite_engine_connect(engine);
+        }
+        if (engine->compact) {
+            se_wire_encoder_init(&engine->wire, SE_WIRE_PACKET_SIZE);
+        }
+    }
+
+    if (engine->use_ring || engine->compact || engine->double_buffer) {
+        engine->vsync_notifier.notify = sprite_engine_vsync;
+        sprite_engine_vsync_add_notifier(&engine->vsync_notifier);
+    }
+}
+
+static int sprite_engine_post_load(void *opaque, int version_id)
+{
+    struct engineblock *engine = opaque;
+
+    // The renderer may not have been up when the destination started
+    if (!engine->use_render && !engine->use_ring && !engine->chr &&
+        engine->sockd == -1) {
+        sprite_engine_connect(engine);
+    }
+    sprite_engine_resend(engine);
+    return 0;
+}
+
+static const VMStateDescription vmstate_se_frame = {
+    .name = "sprite-engine/frame",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(oam, SEFrame, SE_OAM_WORDS),
+        VMSTATE_UINT32_ARRAY(inst, SEFrame, SE_INST_WORDS),
+        VMSTATE_UINT32_ARRAY(cram, SEFrame, SE_CRAM_WORDS),
+        VMSTATE_UINT32(priority, SEFrame),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_sprite_engine = {
+    .name = TYPE_SPRITE_ENGINE,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = sprite_engine_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT(back, struct engineblock, 1, vmstate_se_frame, SEFrame),
+        VMSTATE_STRUCT(front, struct engineblock, 1, vmstate_se_frame,
+                       SEFrame),
+        VMSTATE_BOOL(dirty, struct engineblock),
+        VMSTATE_BUFFER_POINTER_UNSAFE(vram, struct engineblock, 1,
+                                      SE_VRAM_BYTES),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static Property sprite_engine_properties[] = {
+    DEFINE_PROP_STRING("backend", struct engineblock, backend),
+    DEFINE_PROP_CHR("chardev", struct engineblock, chr),
+    DEFINE_PROP_UINT32("port", struct engineblock, port, 1985),
+    DEFINE_PROP_STRING("ring", struct engineblock, ring_path),
+    DEFINE_PROP_UINT32("ring-size", struct engineblock, ring_size, 4096),
+    DEFINE_PROP_BOOL("compact", struct engineblock, compact, false),
+    DEFINE_PROP_BOOL("double-buffer", struct engineblock, double_buffer, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -200,13 +756,13 @@ static void sprite_engine_class_init(ObjectClass *klass, void *data)
 
     dc->realize = sprite_engine_realize;
     dc->props = sprite_engine_properties;
+    dc->vmsd = &vmstate_sprite_engine;
 }
 
 static const TypeInfo sprite_engine_info = {
     .name          = TYPE_SPRITE_ENGINE,
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(struct engineblock),
-    .instance_init = sprite_engine_init,
     .class_init    = sprite_engine_class_init,
 };
 
@@ -0,0 +1,47 @@
+#ifndef SPRITE_ENGINE_H
+#define SPRITE_ENGINE_H
+
+#include "hw/sysbus.h"
+
+#define TYPE_SPRITE_ENGINE "sprite-engine"
+#define SPRITE_ENGINE(obj) \
+    OBJECT_CHECK(struct engineblock, (obj), TYPE_SPRITE_ENGINE)
+
+// MIN and MAX are defined inclusive
+#define SE_REGION_MIN   (0x00000000)
+#define SE_OAM_MIN      (SE_REGION_MIN)
+#define SE_OAM_MAX      (SE_REGION_MIN + 0x1EC)
+// Read only, see SE_STATUS_*
+#define SE_STATUS       (SE_REGION_MIN + 0x1F4)
+// Any write swaps the double buffered registers in, see "double-buffer"
+#define SE_COMMIT       (SE_REGION_MIN + 0x1F8)
+#define SE_PRIORITY_CTL (SE_REGION_MIN + 0x1FC)
+#define SE_INST_MIN     (SE_REGION_MIN + 0x200)
+#define SE_INST_MAX     (SE_REGION_MIN + 0x3FC)
+#define SE_CRAM_MIN     (SE_REGION_MIN + 0x400)
+#define SE_CRAM_MAX     (SE_REGION_MIN + 0x4FC)
+#define SE_VRAM_MIN     (SE_REGION_MIN + 0x800)
+#define SE_VRAM_MAX     (SE_REGION_MIN + 0x803)
+#define SE_REGION_MAX   SE_VRAM_MAX
+
+#define SE_OAM_WORDS    (((SE_OAM_MAX - SE_OAM_MIN) >> 2) + 1)
+#define SE_INST_WORDS   (((SE_INST_MAX - SE_INST_MIN) >> 2) + 1)
+#define SE_CRAM_WORDS   (((SE_CRAM_MAX - SE_CRAM_MIN) >> 2) + 1)
+
+// Commands are waiting for the renderer to make room in the ring.  Stores
+// are still accepted, but a guest should wait for the bit to clear, or for
+// the interrupt pulsed when it does, before queueing another frame.
+#define SE_STATUS_BUSY  (1 << 0)
+
+struct engineblock;
+
+/*
+ * Feed @count register values to the engine as if the guest had stored
+ * them one after the other, starting at register offset @addr.  @addr is
+ * advanced by 4 after each value unless it points at the VRAM port.  The
+ * resulting commands are handed to the renderer in one batch.
+ */
+void sprite_engine_bulk_write(struct engineblock *engine, hwaddr addr,
+                              const uint32_t *vals, size_t count);
+
+#endif // SPRITE_ENGINE_H
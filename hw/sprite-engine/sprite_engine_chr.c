@@ -0,0 +1,99 @@
+/*
+ * Non-blocking chardev output for the sprite engine devices.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "qemu-common.h"
+#include "trace.h"
+#include "hw/sprite-engine/sprite_engine_chr.h"
+
+static void se_chr_out_drop(SEChrOut *o)
+{
+    o->dropped += o->queue->len;
+    trace_se_chr_out_dropped(o->queue->len, o->dropped);
+    g_byte_array_set_size(o->queue, 0);
+}
+
+static gboolean se_chr_out_writable(GIOChannel *chan, GIOCondition cond,
+                                    void *opaque);
+
+static void se_chr_out_drain(SEChrOut *o)
+{
+    int ret;
+
+    while (o->queue->len) {
+        ret = qemu_chr_fe_write(o->chr, o->queue->data, o->queue->len);
+        if (ret <= 0) {
+            break;
+        }
+        g_byte_array_remove_range(o->queue, 0, ret);
+    }
+
+    if (o->queue->len && !o->watch) {
+        o->watch = qemu_chr_fe_add_watch(o->chr, G_IO_OUT | G_IO_HUP,
+                                         se_chr_out_writable, o);
+        if (!o->watch) {
+            // The backend cannot tell when it is writable again
+            se_chr_out_drop(o);
+        }
+    }
+}
+
+static gboolean se_chr_out_writable(GIOChannel *chan, GIOCondition cond,
+                                    void *opaque)
+{
+    SEChrOut *o = opaque;
+
+    o->watch = 0;
+    if (cond & G_IO_HUP) {
+        // Nobody is listening, start over once a peer shows up
+        se_chr_out_drop(o);
+    } else {
+        se_chr_out_drain(o);
+    }
+    return FALSE;
+}
+
+void se_chr_out_init(SEChrOut *o, CharDriverState *chr)
+{
+    o->chr = chr;
+    o->queue = g_byte_array_new();
+    o->watch = 0;
+    o->dropped = 0;
+}
+
+void se_chr_out_write(SEChrOut *o, const void *buf, size_t len)
+{
+    if (o->queue->len + len > SE_CHR_QUEUE_MAX) {
+        o->dropped += len;
+        trace_se_chr_out_dropped(len, o->dropped);
+        return;
+    }
+    g_byte_array_append(o->queue, buf, len);
+    if (!o->watch) {
+        se_chr_out_drain(o);
+    }
+}
+
+// Bytes still waiting for the backend
+size_t se_chr_out_pending(SEChrOut *o)
+{
+    return o->queue->len;
+}
@@ -0,0 +1,28 @@
+#ifndef SPRITE_ENGINE_CHR_H
+#define SPRITE_ENGINE_CHR_H
+
+#include "sysemu/char.h"
+
+/*
+ * Non-blocking output to a character device backend.
+ *
+ * Whatever the backend does not take right away is queued and sent from
+ * a G_IO_OUT watch, so a slow peer never stalls the vCPU.  Writes are
+ * kept or dropped as a whole so the peer never sees a partial message;
+ * once SE_CHR_QUEUE_MAX bytes are pending, new writes are dropped.
+ */
+
+#define SE_CHR_QUEUE_MAX    (1024 * 1024)
+
+typedef struct SEChrOut {
+    CharDriverState *chr;
+    GByteArray *queue;
+    guint watch;
+    uint64_t dropped;
+} SEChrOut;
+
+void se_chr_out_init(SEChrOut *o, CharDriverState *chr);
+void se_chr_out_write(SEChrOut *o, const void *buf, size_t len);
+size_t se_chr_out_pending(SEChrOut *o);
+
+#endif // SPRITE_ENGINE_CHR_H
@@ -46,8 +46,7 @@ union SECommand {
   struct SECommandUpdateVRAM update_vram;
 };
 
-void fillUpdateOAM(uint8_t oam_index, uint32_t val, struct SECommandUpdateOAM *cmd);
-void fillUpdateOAM(uint8_t oam_index, uint32_t val, struct SECommandUpdateOAM *cmd) {
+static inline void fillUpdateOAM(uint8_t oam_index, uint32_t val, struct SECommandUpdateOAM *cmd) {
     memset(cmd, 0, sizeof(struct SECommandUpdateOAM));
     cmd->type = UPDATE_OAM;
     cmd->oam_index = oam_index;
@@ -60,8 +59,7 @@ void fillUpdateOAM(uint8_t oam_index, uint32_t val, struct SECommandUpdateOAM *c
     // other fields 0'd by memset
 }
 
-void fillUpdateInstOAM(uint8_t oam_index, uint64_t val, struct SECommandUpdateOAM *cmd);
-void fillUpdateInstOAM(uint8_t oam_index, uint64_t val, struct SECommandUpdateOAM *cmd) {
+static inline void fillUpdateInstOAM(uint8_t oam_index, uint64_t val, struct SECommandUpdateOAM *cmd) {
     memset(cmd, 0, sizeof(struct SECommandUpdateOAM));
     cmd->type = UPDATE_OAM;
     cmd->oam_index = oam_index;
@@ -76,51 +74,13 @@ void fillUpdateInstOAM(uint8_t oam_index, uint64_t val, struct SECommandUpdateOA
     cmd->transpose = ((val & 0x0000000000000001) != 0) ? true : false;
 }
 
-void debugUpdateOAM(int fd, struct SECommandUpdateOAM *cmd);
-void debugUpdateOAM(int fd, struct SECommandUpdateOAM *cmd) {
-    dprintf(fd, "SECommandUpdateOAM {\n"
-                    "\toam_index:\t%d\n"
-                    "\tenable:\t\t%d\n"
-                    "\tpalette:\t%d\n"
-                    "\tflip_x:\t\t%d\n"
-                    "\tflip_y:\t\t%d\n"
-                    "\tx_offset:\t%d\n"
-                    "\ty_offset:\t%d\n"
-                    "\tsprite_size:\t%d\n"
-                    "\tsprite:\t\t%d\n"
-                    "\ttranspose:\t%d\n"
-                "}\n",
-                cmd->oam_index,
-                cmd->enable,
-                cmd->palette,
-                cmd->flip_x,
-                cmd->flip_y,
-                cmd->x_offset,
-                cmd->y_offset,
-                cmd->sprite_size,
-                cmd->sprite,
-                cmd->transpose
-             );
-}
-
-void fillPriorityControl(uint8_t val, struct SECommandSetPriorityControl *cmd);
-void fillPriorityControl(uint8_t val, struct SECommandSetPriorityControl *cmd) {
+static inline void fillPriorityControl(uint8_t val, struct SECommandSetPriorityControl *cmd) {
     memset(cmd, 0, sizeof(struct SECommandSetPriorityControl));
     cmd->type = SET_PRIORITY_CTRL;
     cmd->iprctl = ((val & 0x01) != 0) ? true : false;
 }
 
-void debugPriorityControl(int fd, struct SECommandSetPriorityControl *cmd);
-void debugPriorityControl(int fd, struct SECommandSetPriorityControl *cmd) {
-    dprintf(fd, "SECommandSetPriorityControl {\n"
-                    "\tiprctl:\t%d\n"
-                    "}\n",
-                    cmd->iprctl
-           );
-}
-
-void fillUpdateCRAM(uint8_t cram_index, uint32_t val, struct SECommandUpdateCRAM *cmd);
-void fillUpdateCRAM(uint8_t cram_index, uint32_t val, struct SECommandUpdateCRAM *cmd) {
+static inline void fillUpdateCRAM(uint8_t cram_index, uint32_t val, struct SECommandUpdateCRAM *cmd) {
     memset(cmd, 0, sizeof(struct SECommandUpdateCRAM));
     cmd->type = UPDATE_CRAM;
     cmd->cram_index = cram_index;
@@ -131,27 +91,7 @@ void fillUpdateCRAM(uint8_t cram_index, uint32_t val, struct SECommandUpdateCRAM
     cmd->blue = (val & 0x000000FF);
 }
 
-void debugUpdateCRAM(int fd, struct SECommandUpdateCRAM *cmd);
-void debugUpdateCRAM(int fd, struct SECommandUpdateCRAM *cmd) {
-    dprintf(fd, "SECommandUpdateCRAM {\n"
-                    "\tcram_index:\t%d\n"
-                    "\tpalette_index:\t%d\n"
-                    "\tuser:\t\t%d\n"
-                    "\tred:\t\t%d\n"
-                    "\tgreen:\t\t%d\n"
-                    "\tblue:\t\t%d\n"
-                    "}\n",
-                    cmd->cram_index,
-                    cmd->palette_index,
-                    cmd->user,
-                    cmd->red,
-                    cmd->green,
-                    cmd->blue
-           );
-}
-
-void fillUpdateVRAM(uint8_t cram_index, uint32_t val, struct SECommandUpdateVRAM *cmd);
-void fillUpdateVRAM(uint8_t cram_index, uint32_t val, struct SECommandUpdateVRAM *cmd) {
+static inline void fillUpdateVRAM(uint8_t cram_index, uint32_t val, struct SECommandUpdateVRAM *cmd) {
     memset(cmd, 0, sizeof(struct SECommandUpdateVRAM));
     cmd->type = UPDATE_VRAM;
     cmd->chunk = ((val & 0xFF800000) >> 23);
@@ -161,19 +101,4 @@ void fillUpdateVRAM(uint8_t cram_index, uint32_t val, struct SECommandUpdateVRAM
 }
 
 
-void debugUpdateVRAM(int fd, struct SECommandUpdateVRAM *cmd);
-void debugUpdateVRAM(int fd, struct SECommandUpdateVRAM *cmd) {
-    dprintf(fd, "SECommandUpdateVRAM {\n"
-                    "\tchunk:\t\t%d\n"
-                    "\tpixel_y:\t%d\n"
-                    "\tpixel_x:\t%d\n"
-                    "\tp_data:\t\t%d\n"
-                    "}\n",
-                    cmd->chunk,
-                    cmd->pixel_y,
-                    cmd->pixel_x,
-                    cmd->p_data
-           );
-}
-
 #endif // SPRITE_ENGINE_COMMANDS_H
@@ -25,9 +25,12 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include "hw/sysbus.h"
-#include "hw/ptimer.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
+#include "qemu/atomic.h"
+#include "qemu/error-report.h"
+#include "qemu/sockets.h"
+#include "sysemu/char.h"
 
 #define TYPE_SPRITE_ENGINE_CONTROLLER "sprite-engine-controller"
 #define SPRITE_ENGINE_CONTROLLER(obj) \
@@ -41,9 +44,18 @@ struct control
     SysBusDevice parent_obj;
 
     MemoryRegion mmio;
+    qemu_irq irq;
     uint32_t port;
-    QemuThread server_thread;
-    QemuMutex reg_lock;
+    int listen_fd;
+    int conn_fd;
+
+    // Character device used instead of listening on port when set
+    CharDriverState *chr;
+
+    // Partial update received so far
+    uint8_t update[sizeof(uint32_t)];
+    int update_len;
+
     uint32_t reg;
 };
 
@@ -54,22 +66,16 @@ sprite_engine_controller_read(void *opaque, hwaddr addr, unsigned int size)
 
     assert(addr == CONTROL_REGION);
     assert(size == 4);
-    uint32_t val;
-    qemu_mutex_lock(&c->reg_lock);
-    val = c->reg;
-    qemu_mutex_unlock(&c->reg_lock);
 
-    return val;
+    return atomic_read(&c->reg);
 }
 
 static void
 sprite_engine_controller_write(void *opaque, hwaddr addr,
             uint64_t val64, unsigned int size)
 {
-    int log = open("/tmp/se-control-write.log", O_CREAT | O_RDWR | O_APPEND, 0777);
-
-    dprintf(log, "sprite_engine_controller_write: don't write to these plz thx");
-    close(log);
+    qemu_log_mask(LOG_GUEST_ERROR,
+                  "sprite_engine_controller_write: register is read-only\n");
 }
 
 static const MemoryRegionOps sprite_engine_controller_ops = {
@@ -82,60 +88,117 @@ static const MemoryRegionOps sprite_engine_controller_ops = {
     }
 };
 
-static void sprite_engine_controller_svr_main(void* args) {
-    int rv;
-    int sockd;
-    int connd;
-    struct sockaddr_in server;
-    struct sockaddr_in client;
-    int log = open("/tmp/se-controller-svr-main.log", O_CREAT | O_RDWR | O_APPEND, 0777);
-    struct control* c = (struct control*) ((struct control*) args);
+static void sprite_engine_controller_disconnect(struct control *c)
+{
+    qemu_set_fd_handler(c->conn_fd, NULL, NULL, NULL);
+    close(c->conn_fd);
+    c->conn_fd = -1;
+    c->update_len = 0;
+}
 
+static void sprite_engine_controller_update(struct control *c, uint32_t val)
+{
+    if (val == atomic_read(&c->reg)) {
+        return;
+    }
+    atomic_set(&c->reg, val);
+    // Edge on every change, so the guest does not have to poll
+    qemu_irq_pulse(c->irq);
+}
 
-    dprintf(log, "sprite_engine_controller_svr_main: binding to port %d\n", c->port);
+// Updates are 32-bit values in host byte order, back to back
+static void sprite_engine_controller_receive(void *opaque, const uint8_t *buf,
+                                             int size)
+{
+    struct control *c = opaque;
 
-    sockd = socket(PF_INET, SOCK_STREAM, 0);
-    if (sockd == -1) {
-        dprintf(log, "sprite_engine_controller_svr_main: failed to create socket");
-        return;
+    while (size > 0) {
+        int len = MIN(size, sizeof(c->update) - c->update_len);
+
+        memcpy(c->update + c->update_len, buf, len);
+        c->update_len += len;
+        buf += len;
+        size -= len;
+        if (c->update_len == sizeof(c->update)) {
+            uint32_t val;
+
+            memcpy(&val, c->update, sizeof(val));
+            c->update_len = 0;
+            sprite_engine_controller_update(c, val);
+        }
     }
+}
 
-    memset(&server, 0, sizeof(struct sockaddr_in));
-    server.sin_addr.s_addr = inet_addr("127.0.0.1");
-    server.sin_family = PF_INET;
-    server.sin_port = htons(c->port);
-    rv = bind(sockd, (struct sockaddr *) &server, sizeof(server));
-    if (rv == -1) {
-        dprintf(log, "sprite_engine_controller_svr_main: failed to bind to port");
+static int sprite_engine_controller_can_receive(void *opaque)
+{
+    struct control *c = opaque;
+
+    return sizeof(c->update) - c->update_len;
+}
+
+static void sprite_engine_controller_readable(void *opaque)
+{
+    struct control *c = opaque;
+    uint8_t buf[64];
+    ssize_t len;
+
+    len = read(c->conn_fd, buf, sizeof(buf));
+    if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
         return;
     }
-
-    // backlog of 1. Should only be 1 connection
-    rv = listen(sockd, 1);
-    if (rv == -1) {
-        dprintf(log, "sprite_engine_controller_svr_main: listen failed");
+    if (len <= 0) {
+        sprite_engine_controller_disconnect(c);
         return;
     }
+    sprite_engine_controller_receive(c, buf, len);
+}
+
+static void sprite_engine_controller_accept(void *opaque)
+{
+    struct control *c = opaque;
+    struct sockaddr_in client;
+    socklen_t client_length = sizeof(client);
+    int connd;
 
-    int client_length = sizeof(client);
-    connd = accept(sockd, (struct sockaddr*) &client, (socklen_t *) &client_length);
+    connd = qemu_accept(c->listen_fd, (struct sockaddr *) &client,
+                        &client_length);
     if (connd == -1) {
-        dprintf(log, "sprite_engine_controller_svr_main: failed to accept");
         return;
     }
+    // Should only be 1 connection, a new one replaces the old one
+    if (c->conn_fd != -1) {
+        sprite_engine_controller_disconnect(c);
+    }
+    qemu_set_nonblock(connd);
+    c->conn_fd = connd;
+    qemu_set_fd_handler(connd, sprite_engine_controller_readable, NULL, c);
+}
 
-    // continually read new reg values, and store them
-    int reg_update;
-    while (1) {
-        ssize_t read_size = read(connd, &reg_update, sizeof(int)); 
-        if (read_size != sizeof(int)) {
-            dprintf(log, "sprite_engine_controller_svr_main: weird read size of %zd", read_size);
-        } else {
-            qemu_mutex_lock(&c->reg_lock);
-            c->reg = reg_update;
-            qemu_mutex_unlock(&c->reg_lock);
-        }
+/* Return the listening socket, or -errno on failure */
+static int sprite_engine_controller_listen(struct control *c)
+{
+    struct sockaddr_in server;
+    int sockd;
+    int err;
+
+    sockd = qemu_socket(PF_INET, SOCK_STREAM, 0);
+    if (sockd == -1) {
+        return -errno;
     }
+    socket_set_fast_reuse(sockd);
+
+    memset(&server, 0, sizeof(struct sockaddr_in));
+    server.sin_addr.s_addr = inet_addr("127.0.0.1");
+    server.sin_family = PF_INET;
+    server.sin_port = htons(c->port);
+    if (bind(sockd, (struct sockaddr *) &server, sizeof(server)) == -1 ||
+        listen(sockd, 1) == -1) {
+        err = errno;
+        close(sockd);
+        return -err;
+    }
+    qemu_set_nonblock(sockd);
+    return sockd;
 }
 
 static void sprite_engine_controller_realize(DeviceState *dev, Error **errp)
@@ -144,24 +207,40 @@ static void sprite_engine_controller_realize(DeviceState *dev, Error **errp)
 
     memory_region_init_io(&c->mmio, OBJECT(c), &sprite_engine_controller_ops, c, "sprite-engine-control", 0x01);
     sysbus_init_mmio(SYS_BUS_DEVICE(dev), &c->mmio);
+    sysbus_init_irq(SYS_BUS_DEVICE(dev), &c->irq);
 
-    // launch ctrl server
-    qemu_thread_create(&c->server_thread, "se_ctrl_th",
-                       (void *) sprite_engine_controller_svr_main,
-                       (void *) c, QEMU_THREAD_JOINABLE);
-}
-
-
-
-static void sprite_engine_controller_init(Object *obj)
-{
-    struct control *c = SPRITE_ENGINE_CONTROLLER(obj);
+    c->conn_fd = -1;
+    c->listen_fd = -1;
+    if (c->chr) {
+        qemu_chr_add_handlers(c->chr, sprite_engine_controller_can_receive,
+                              sprite_engine_controller_receive, NULL, c);
+        return;
+    }
 
-    qemu_mutex_init(&c->reg_lock);
+    c->listen_fd = sprite_engine_controller_listen(c);
+    if (c->listen_fd < 0) {
+        error_report("sprite-engine-controller: cannot listen on port %u: %s",
+                     c->port, strerror(-c->listen_fd));
+        c->listen_fd = -1;
+        return;
+    }
+    qemu_set_fd_handler(c->listen_fd, sprite_engine_controller_accept,
+                        NULL, c);
 }
 
+static const VMStateDescription vmstate_sprite_engine_controller = {
+    .name = TYPE_SPRITE_ENGINE_CONTROLLER,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(reg, struct control),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static Property sprite_engine_controller_properties[] = {
     DEFINE_PROP_UINT32("port", struct control, port, -1),
+    DEFINE_PROP_CHR("chardev", struct control, chr),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -171,13 +250,13 @@ static void sprite_engine_controller_class_init(ObjectClass *klass, void *data)
 
     dc->realize = sprite_engine_controller_realize;
     dc->props = sprite_engine_controller_properties;
+    dc->vmsd = &vmstate_sprite_engine_controller;
 }
 
 static const TypeInfo sprite_engine_controller_info = {
     .name          = TYPE_SPRITE_ENGINE_CONTROLLER,
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(struct control),
-    .instance_init = sprite_engine_controller_init,
     .class_init    = sprite_engine_controller_class_init,
 };
 
@@ -0,0 +1,303 @@
+/*
+ * QEMU model of the sprite engine upload DMA.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The guest builds a chain of descriptors in RAM, each made of four
+ * 32-bit words in guest byte order:
+ *
+ *   0x0  next    address of the next descriptor, 0 ends the chain
+ *   0x4  src     address of the register values to upload
+ *   0x8  len     length of the buffer in bytes, a multiple of 4
+ *   0xc  dst     sprite engine register offset the values are written to
+ *
+ * Values are written to consecutive registers starting at dst, except
+ * for the VRAM port which takes every value of the buffer.  Writing
+ * CTRL_START with DESC pointing at the first descriptor runs the whole
+ * chain; STATUS_DONE is raised when it completes and, if CTRL_IRQ_EN is
+ * set, the interrupt line follows STATUS_DONE | STATUS_ERR.
+ */
+
+#include "hw/sysbus.h"
+#include "qemu/log.h"
+#include "sysemu/dma.h"
+#include "exec/address-spaces.h"
+#include "trace.h"
+
+#include "hw/sprite-engine/sprite_engine.h"
+
+#define TYPE_SPRITE_ENGINE_DMA "sprite-engine.dma"
+#define SPRITE_ENGINE_DMA(obj) \
+    OBJECT_CHECK(struct dmablock, (obj), TYPE_SPRITE_ENGINE_DMA)
+
+#define R_DESC      0
+#define R_CTRL      1
+#define R_STATUS    2
+#define R_COUNT     3   /* number of words uploaded by the last chain */
+#define R_MAX       4
+
+#define CTRL_START      (1 << 0)
+#define CTRL_IRQ_EN     (1 << 1)
+
+#define STATUS_DONE     (1 << 0)
+#define STATUS_ERR      (1 << 1)
+
+#define DESC_SIZE       16
+// Guard against descriptor loops and runaway lengths
+#define DESC_MAX        4096
+#define DESC_LEN_MAX    (16 * 1024 * 1024)
+
+struct dmablock
+{
+    SysBusDevice parent_obj;
+
+    MemoryRegion mmio;
+    qemu_irq irq;
+    struct engineblock *engine;
+    bool big_endian;
+    uint32_t regs[R_MAX];
+};
+
+static void sprite_engine_dma_update_irq(struct dmablock *d)
+{
+    bool level = (d->regs[R_CTRL] & CTRL_IRQ_EN) &&
+                 (d->regs[R_STATUS] & (STATUS_DONE | STATUS_ERR));
+
+    qemu_set_irq(d->irq, level);
+}
+
+static uint32_t sprite_engine_dma_ldl(struct dmablock *d, const void *p)
+{
+    return d->big_endian ? ldl_be_p(p) : ldl_le_p(p);
+}
+
+static bool sprite_engine_dma_upload(struct dmablock *d, dma_addr_t src,
+                                     uint32_t len, uint32_t dst)
+{
+    size_t count = len / 4;
+    dma_addr_t plen = len;
+    uint32_t *vals;
+    uint8_t *buf;
+    size_t i;
+
+    if (len & 3 || len > DESC_LEN_MAX) {
+        return false;
+    }
+    if (!len) {
+        return true;
+    }
+
+    // Read straight out of guest RAM when it can be mapped in one piece
+    buf = dma_memory_map(&address_space_memory, src, &plen,
+                         DMA_DIRECTION_TO_DEVICE);
+    if (buf && plen < len) {
+        dma_memory_unmap(&address_space_memory, buf, plen,
+                         DMA_DIRECTION_TO_DEVICE, 0);
+        buf = NULL;
+    }
+
+    vals = g_new(uint32_t, count);
+    if (buf) {
+        for (i = 0; i < count; i++) {
+            vals[i] = sprite_engine_dma_ldl(d, buf + i * 4);
+        }
+        dma_memory_unmap(&address_space_memory, buf, plen,
+                         DMA_DIRECTION_TO_DEVICE, plen);
+    } else {
+        if (dma_memory_read(&address_space_memory, src, vals, len)) {
+            g_free(vals);
+            return false;
+        }
+        for (i = 0; i < count; i++) {
+            vals[i] = sprite_engine_dma_ldl(d, &vals[i]);
+        }
+    }
+
+    sprite_engine_bulk_write(d->engine, dst, vals, count);
+    d->regs[R_COUNT] += count;
+    g_free(vals);
+    return true;
+}
+
+static void sprite_engine_dma_run(struct dmablock *d)
+{
+    dma_addr_t desc = d->regs[R_DESC];
+    uint8_t raw[DESC_SIZE];
+    int n;
+
+    d->regs[R_COUNT] = 0;
+    for (n = 0; desc && n < DESC_MAX; n++) {
+        uint32_t next, src, len, dst;
+
+        if (dma_memory_read(&address_space_memory, desc, raw, DESC_SIZE)) {
+            break;
+        }
+        next = sprite_engine_dma_ldl(d, raw);
+        src = sprite_engine_dma_ldl(d, raw + 4);
+        len = sprite_engine_dma_ldl(d, raw + 8);
+        dst = sprite_engine_dma_ldl(d, raw + 12);
+        trace_sprite_engine_dma_desc(desc, src, len, dst);
+
+        if (!sprite_engine_dma_upload(d, src, len, dst)) {
+            break;
+        }
+        desc = next;
+    }
+
+    if (desc) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "sprite-engine.dma: bad descriptor at 0x%" PRIx64 "\n",
+                      (uint64_t) desc);
+        d->regs[R_STATUS] |= STATUS_ERR;
+    }
+    d->regs[R_STATUS] |= STATUS_DONE;
+    d->regs[R_CTRL] &= ~CTRL_START;
+    sprite_engine_dma_update_irq(d);
+}
+
+static uint64_t
+sprite_engine_dma_read(void *opaque, hwaddr addr, unsigned int size)
+{
+    struct dmablock *d = opaque;
+
+    return d->regs[addr >> 2];
+}
+
+static void
+sprite_engine_dma_write(void *opaque, hwaddr addr,
+            uint64_t val64, unsigned int size)
+{
+    struct dmablock *d = opaque;
+    uint32_t value = val64;
+
+    addr >>= 2;
+    switch (addr) {
+    case R_STATUS:
+        // Write one to clear
+        d->regs[R_STATUS] &= ~value;
+        break;
+    case R_COUNT:
+        break;
+    case R_CTRL:
+        d->regs[R_CTRL] = value;
+        if (value & CTRL_START) {
+            sprite_engine_dma_run(d);
+        }
+        break;
+    default:
+        d->regs[addr] = value;
+        break;
+    }
+    sprite_engine_dma_update_irq(d);
+}
+
+static const MemoryRegionOps sprite_engine_dma_ops = {
+    .read = sprite_engine_dma_read,
+    .write = sprite_engine_dma_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4
+    }
+};
+
+static void sprite_engine_dma_realize(DeviceState *dev, Error **errp)
+{
+    struct dmablock *d = SPRITE_ENGINE_DMA(dev);
+
+    if (!d->engine) {
+        error_setg(errp, "sprite-engine.dma: 'sprite-engine' link not set");
+        return;
+    }
+}
+
+static void sprite_engine_dma_reset(DeviceState *dev)
+{
+    struct dmablock *d = SPRITE_ENGINE_DMA(dev);
+
+    memset(d->regs, 0, sizeof(d->regs));
+}
+
+static void sprite_engine_dma_init(Object *obj)
+{
+    struct dmablock *d = SPRITE_ENGINE_DMA(obj);
+
+    object_property_add_link(obj, "sprite-engine", TYPE_SPRITE_ENGINE,
+                             (Object **)&d->engine,
+                             qdev_prop_allow_set_link_before_realize,
+                             OBJ_PROP_LINK_UNREF_ON_RELEASE,
+                             &error_abort);
+
+    memory_region_init_io(&d->mmio, obj, &sprite_engine_dma_ops, d,
+                          "sprite-engine.dma", R_MAX * 4);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &d->mmio);
+    sysbus_init_irq(SYS_BUS_DEVICE(obj), &d->irq);
+}
+
+static int sprite_engine_dma_post_load(void *opaque, int version_id)
+{
+    struct dmablock *d = opaque;
+
+    // The line level follows from CTRL and STATUS
+    sprite_engine_dma_update_irq(d);
+    return 0;
+}
+
+static const VMStateDescription vmstate_sprite_engine_dma = {
+    .name = TYPE_SPRITE_ENGINE_DMA,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = sprite_engine_dma_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, struct dmablock, R_MAX),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property sprite_engine_dma_properties[] = {
+    DEFINE_PROP_BOOL("big-endian", struct dmablock, big_endian, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void sprite_engine_dma_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = sprite_engine_dma_realize;
+    dc->reset = sprite_engine_dma_reset;
+    dc->props = sprite_engine_dma_properties;
+    dc->vmsd = &vmstate_sprite_engine_dma;
+}
+
+static const TypeInfo sprite_engine_dma_info = {
+    .name          = TYPE_SPRITE_ENGINE_DMA,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(struct dmablock),
+    .instance_init = sprite_engine_dma_init,
+    .class_init    = sprite_engine_dma_class_init,
+};
+
+static void sprite_engine_dma_register_types(void)
+{
+    type_register_static(&sprite_engine_dma_info);
+}
+
+type_init(sprite_engine_dma_register_types)
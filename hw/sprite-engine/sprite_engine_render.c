@@ -0,0 +1,165 @@
+/*
+ * Reference renderer for sprite engine commands.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "qemu-common.h"
+#include "hw/sprite-engine/sprite_engine_render.h"
+
+void se_render_init(SERenderer *r)
+{
+    memset(r->oam, 0, sizeof(r->oam));
+    memset(r->clut, 0, sizeof(r->clut));
+    r->vram = g_malloc0(SE_RENDER_CHUNKS * sizeof(*r->vram));
+    r->iprctl = false;
+    r->dirty = true;
+}
+
+void se_render_cleanup(SERenderer *r)
+{
+    g_free(r->vram);
+    r->vram = NULL;
+}
+
+void se_render_apply(SERenderer *r, const union SECommand *cmd)
+{
+    switch (cmd->type) {
+    case UPDATE_OAM:
+        r->oam[cmd->update_oam.oam_index] = cmd->update_oam;
+        break;
+    case SET_PRIORITY_CTRL:
+        r->iprctl = cmd->set_priority_control.iprctl;
+        break;
+    case UPDATE_CRAM: {
+        const struct SECommandUpdateCRAM *c = &cmd->update_cram;
+        unsigned palette = (c->cram_index / SE_RENDER_COLOURS) %
+                           SE_RENDER_PALETTES;
+
+        r->clut[palette][c->palette_index] =
+            (c->red << 16) | (c->green << 8) | c->blue;
+        break;
+    }
+    case UPDATE_VRAM: {
+        const struct SECommandUpdateVRAM *v = &cmd->update_vram;
+
+        r->vram[v->chunk % SE_RENDER_CHUNKS][v->pixel_y % SE_RENDER_CHUNK_DIM]
+               [v->pixel_x % SE_RENDER_CHUNK_DIM] = v->p_data;
+        break;
+    }
+    default:
+        return;
+    }
+    r->dirty = true;
+}
+
+/*
+ * Copy the opaque pixels of @src over @dest.  Written without branches
+ * on the pixel value so that the compiler can turn it into vector code.
+ */
+static void se_render_blit_row(uint32_t *dest, const uint8_t *src, int n,
+                               const uint32_t *pal)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t mask = -(uint32_t) (src[i] != 0);
+        dest[i] = (pal[src[i]] & mask) | (dest[i] & ~mask);
+    }
+}
+
+static void se_render_sprite(SERenderer *r, int index, uint32_t *dest,
+                             size_t stride)
+{
+    const struct SECommandUpdateOAM *o = &r->oam[index];
+    const uint8_t (*chunk)[SE_RENDER_CHUNK_DIM];
+    const uint32_t *pal = r->clut[o->palette % SE_RENDER_PALETTES];
+    uint8_t row[SE_RENDER_CHUNK_DIM];
+    int dim, width, y, i;
+
+    if (index < SE_RENDER_INST_BASE) {
+        chunk = r->vram[index];
+        dim = SE_RENDER_CHUNK_DIM;
+    } else {
+        chunk = r->vram[o->sprite];
+        dim = 8 << o->sprite_size;
+    }
+
+    // Sprites hang off the right and bottom edges, never the left or top
+    width = MIN(dim, SE_RENDER_WIDTH - o->x_offset);
+    if (width <= 0 || o->y_offset >= SE_RENDER_HEIGHT) {
+        return;
+    }
+
+    for (y = 0; y < dim && o->y_offset + y < SE_RENDER_HEIGHT; y++) {
+        int sy = o->flip_y ? dim - 1 - y : y;
+        uint32_t *line = (uint32_t *) ((uint8_t *) dest +
+                                       (o->y_offset + y) * stride);
+
+        if (o->transpose) {
+            for (i = 0; i < dim; i++) {
+                row[i] = chunk[i][sy];
+            }
+        } else {
+            memcpy(row, chunk[sy], dim);
+        }
+        if (o->flip_x) {
+            for (i = 0; i < dim / 2; i++) {
+                uint8_t t = row[i];
+                row[i] = row[dim - 1 - i];
+                row[dim - 1 - i] = t;
+            }
+        }
+        se_render_blit_row(line + o->x_offset, row, width, pal);
+    }
+}
+
+static void se_render_range(SERenderer *r, int first, int last,
+                            uint32_t *dest, size_t stride)
+{
+    int i;
+
+    // Back to front, so that lower indexes end up on top
+    for (i = last; i >= first; i--) {
+        if (r->oam[i].enable) {
+            se_render_sprite(r, i, dest, stride);
+        }
+    }
+}
+
+void se_render_frame(SERenderer *r, uint32_t *dest, size_t stride)
+{
+    int y;
+
+    for (y = 0; y < SE_RENDER_HEIGHT; y++) {
+        memset((uint8_t *) dest + y * stride, 0,
+               SE_RENDER_WIDTH * sizeof(uint32_t));
+    }
+
+    if (r->iprctl) {
+        se_render_range(r, 0, SE_RENDER_INST_BASE - 1, dest, stride);
+        se_render_range(r, SE_RENDER_INST_BASE, SE_RENDER_SLOTS - 1,
+                        dest, stride);
+    } else {
+        se_render_range(r, SE_RENDER_INST_BASE, SE_RENDER_SLOTS - 1,
+                        dest, stride);
+        se_render_range(r, 0, SE_RENDER_INST_BASE - 1, dest, stride);
+    }
+    r->dirty = false;
+}
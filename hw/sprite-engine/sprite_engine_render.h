@@ -0,0 +1,58 @@
+#ifndef SPRITE_ENGINE_RENDER_H
+#define SPRITE_ENGINE_RENDER_H
+
+#include "hw/sprite-engine/sprite_engine_commands.h"
+
+/*
+ * Reference renderer for sprite engine commands, used when the device is
+ * created with backend=internal instead of talking to an external one.
+ *
+ * The renderer keeps its own copy of the state the commands describe and
+ * composites a SE_RENDER_WIDTH x SE_RENDER_HEIGHT frame from it:
+ *
+ *   VRAM   SE_RENDER_CHUNKS chunks of SE_RENDER_CHUNK_DIM square 4-bit
+ *          pixels.
+ *   CRAM   SE_RENDER_PALETTES palettes of 16 colours.  CRAM word n sets
+ *          colour palette_index of palette n / 16.  Colour 0 of every
+ *          palette is transparent.
+ *   OAM    objects written through the OAM window (oam_index below
+ *          SE_RENDER_INST_BASE) show the whole of VRAM chunk oam_index.
+ *          Instances show chunk sprite, cropped to 8 << sprite_size
+ *          pixels.  Both use palette palette % SE_RENDER_PALETTES.
+ *
+ * Lower indexes are drawn on top.  Instances are drawn above the OAM
+ * objects when the priority control bit is set, below them otherwise.
+ */
+
+#define SE_RENDER_WIDTH         640
+#define SE_RENDER_HEIGHT        480
+
+#define SE_RENDER_CHUNKS        512
+#define SE_RENDER_CHUNK_DIM     64
+#define SE_RENDER_PALETTES      4
+#define SE_RENDER_COLOURS       16
+#define SE_RENDER_SLOTS         256
+#define SE_RENDER_INST_BASE     128
+
+typedef struct SERenderer {
+    struct SECommandUpdateOAM oam[SE_RENDER_SLOTS];
+    /* 0x00rrggbb, the format of a 32 bpp DisplaySurface */
+    uint32_t clut[SE_RENDER_PALETTES][SE_RENDER_COLOURS];
+    uint8_t (*vram)[SE_RENDER_CHUNK_DIM][SE_RENDER_CHUNK_DIM];
+    bool iprctl;
+    /* Set by every command, cleared by se_render_frame() */
+    bool dirty;
+} SERenderer;
+
+void se_render_init(SERenderer *r);
+void se_render_cleanup(SERenderer *r);
+
+void se_render_apply(SERenderer *r, const union SECommand *cmd);
+
+/*
+ * Composite the current state into @dest, SE_RENDER_HEIGHT rows of
+ * SE_RENDER_WIDTH pixels that start @stride bytes apart.
+ */
+void se_render_frame(SERenderer *r, uint32_t *dest, size_t stride);
+
+#endif // SPRITE_ENGINE_RENDER_H
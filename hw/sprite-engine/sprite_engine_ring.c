@@ -0,0 +1,266 @@
+/*
+ * Shared memory command ring for the sprite engine.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "qemu-common.h"
+#include "qemu/atomic.h"
+#include "qemu/sockets.h"
+#include "hw/sprite-engine/sprite_engine_ring.h"
+
+/* Entries held back while the ring is full, in ring sizes */
+#define SE_RING_BACKLOG_RINGS   16
+
+static int se_ring_alloc_fd(size_t size, Error **errp)
+{
+    int fd = -1;
+
+#if defined(__linux__) && defined(__NR_memfd_create)
+    fd = syscall(__NR_memfd_create, "sprite-engine-ring", 0);
+#endif
+    if (fd < 0) {
+        char *name = g_strdup_printf("/sprite-engine-ring-%d", getpid());
+
+        fd = shm_open(name, O_CREAT | O_RDWR | O_EXCL, S_IRUSR | S_IWUSR);
+        if (fd >= 0) {
+            shm_unlink(name);
+        }
+        g_free(name);
+    }
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "sprite-engine: cannot create ring");
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {
+        error_setg_errno(errp, errno, "sprite-engine: cannot size ring");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int se_ring_send_fds(SERing *r, const SERingHello *hello)
+{
+    struct msghdr msgh;
+    struct iovec iov;
+    int fds[2] = { r->mem_fd, event_notifier_get_fd(&r->doorbell) };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct cmsghdr *cmsg;
+    ssize_t ret;
+
+    memset(&msgh, 0, sizeof(msgh));
+    memset(control, 0, sizeof(control));
+
+    iov.iov_base = (void *) hello;
+    iov.iov_len = sizeof(*hello);
+    msgh.msg_iov = &iov;
+    msgh.msg_iovlen = 1;
+    msgh.msg_control = control;
+    msgh.msg_controllen = sizeof(control);
+
+    cmsg = CMSG_FIRSTHDR(&msgh);
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    do {
+        ret = sendmsg(r->sock_fd, &msgh, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret == sizeof(*hello) ? 0 : -1;
+}
+
+int se_ring_init(SERing *r, const char *path, uint32_t nr_entries,
+                 uint32_t entry_size, Error **errp)
+{
+    SERingHello hello;
+    int ret;
+
+    if (nr_entries == 0 || !is_power_of_2(nr_entries)) {
+        error_setg(errp, "sprite-engine: ring size must be a power of 2");
+        return -1;
+    }
+
+    memset(r, 0, sizeof(*r));
+    r->mem_fd = -1;
+    r->sock_fd = -1;
+    r->entry_size = entry_size;
+    r->mask = nr_entries - 1;
+    r->high_water = nr_entries - nr_entries / 4;
+    r->map_size = sizeof(SERingShared) + (size_t) nr_entries * entry_size;
+    r->backlog = g_byte_array_new();
+
+    r->mem_fd = se_ring_alloc_fd(r->map_size, errp);
+    if (r->mem_fd < 0) {
+        return -1;
+    }
+
+    r->shared = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     r->mem_fd, 0);
+    if (r->shared == MAP_FAILED) {
+        error_setg_errno(errp, errno, "sprite-engine: cannot map ring");
+        r->shared = NULL;
+        goto fail;
+    }
+    r->entries = (uint8_t *) (r->shared + 1);
+    r->shared->magic = SE_RING_MAGIC;
+    r->shared->version = SE_RING_VERSION;
+    r->shared->entry_size = entry_size;
+    r->shared->nr_entries = nr_entries;
+    r->shared->head = 0;
+    r->shared->tail = 0;
+
+    ret = event_notifier_init(&r->doorbell, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "sprite-engine: cannot create doorbell");
+        goto fail;
+    }
+
+    r->sock_fd = unix_connect(path, errp);
+    if (r->sock_fd < 0) {
+        goto fail_doorbell;
+    }
+
+    hello.magic = SE_RING_MAGIC;
+    hello.version = SE_RING_VERSION;
+    hello.entry_size = entry_size;
+    hello.nr_entries = nr_entries;
+    hello.map_size = r->map_size;
+    if (se_ring_send_fds(r, &hello) < 0) {
+        error_setg_errno(errp, errno, "sprite-engine: cannot pass ring to %s",
+                         path);
+        goto fail_doorbell;
+    }
+    return 0;
+
+fail_doorbell:
+    event_notifier_cleanup(&r->doorbell);
+fail:
+    se_ring_cleanup(r);
+    return -1;
+}
+
+void se_ring_cleanup(SERing *r)
+{
+    if (r->sock_fd >= 0) {
+        close(r->sock_fd);
+        r->sock_fd = -1;
+    }
+    if (r->shared) {
+        munmap(r->shared, r->map_size);
+        r->shared = NULL;
+        r->entries = NULL;
+    }
+    if (r->mem_fd >= 0) {
+        close(r->mem_fd);
+        r->mem_fd = -1;
+    }
+    if (r->backlog) {
+        g_byte_array_free(r->backlog, TRUE);
+        r->backlog = NULL;
+    }
+}
+
+void se_ring_flush(SERing *r)
+{
+    if (r->head == r->published) {
+        return;
+    }
+    /* Entries must be visible before the index that covers them */
+    smp_wmb();
+    atomic_set(&r->shared->head, r->head);
+    r->published = r->head;
+    event_notifier_set(&r->doorbell);
+}
+
+static bool se_ring_has_room(SERing *r)
+{
+    return r->head - atomic_read(&r->shared->tail) <= r->mask;
+}
+
+static void se_ring_put(SERing *r, const void *entry)
+{
+    /* Do not overwrite a slot before the consumer is done reading it */
+    smp_mb();
+
+    memcpy(r->entries + (size_t) (r->head & r->mask) * r->entry_size,
+           entry, r->entry_size);
+    r->head++;
+
+    if (r->head - r->published >= r->high_water) {
+        se_ring_flush(r);
+    }
+}
+
+/*
+ * Queue one entry.  The entry only becomes visible to the renderer on the
+ * next se_ring_flush(), which happens here once high_water entries are
+ * pending.  While the ring is full entries go to a backlog instead, and
+ * se_ring_busy() is true until se_ring_drain() has moved them all to the
+ * ring; nothing waits for the renderer here.  Only when the backlog is
+ * full too is the entry dropped and false returned.
+ */
+bool se_ring_push(SERing *r, const void *entry)
+{
+    if (!r->backlog->len && se_ring_has_room(r)) {
+        se_ring_put(r, entry);
+        return true;
+    }
+
+    se_ring_flush(r);
+    if (r->backlog->len >= (size_t) SE_RING_BACKLOG_RINGS *
+                           (r->mask + 1) * r->entry_size) {
+        r->dropped++;
+        return false;
+    }
+    g_byte_array_append(r->backlog, entry, r->entry_size);
+    return true;
+}
+
+bool se_ring_busy(SERing *r)
+{
+    return r->backlog->len != 0;
+}
+
+/*
+ * Move as much of the backlog to the ring as the renderer has made room
+ * for, and publish it.  Returns true once the backlog is empty.
+ */
+bool se_ring_drain(SERing *r)
+{
+    size_t done = 0;
+
+    while (done < r->backlog->len && se_ring_has_room(r)) {
+        se_ring_put(r, r->backlog->data + done);
+        done += r->entry_size;
+    }
+    if (done) {
+        g_byte_array_remove_range(r->backlog, 0, done);
+    }
+    se_ring_flush(r);
+    return !r->backlog->len;
+}
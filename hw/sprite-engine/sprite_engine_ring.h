@@ -0,0 +1,77 @@
+#ifndef SPRITE_ENGINE_RING_H
+#define SPRITE_ENGINE_RING_H
+
+#include <glib.h>
+#include "qemu/event_notifier.h"
+#include "qapi/error.h"
+
+/*
+ * Shared memory command ring between the sprite engine and the renderer.
+ *
+ * The segment starts with a SERingShared header followed by nr_entries
+ * slots of entry_size bytes each.  QEMU is the only producer and the
+ * renderer the only consumer.  Both indexes are free running; a slot is
+ * addressed by (index & (nr_entries - 1)).
+ *
+ * The producer publishes new entries in batches by storing head, then
+ * kicks the doorbell eventfd.  The consumer stores tail once it is done
+ * with the entries before it.
+ *
+ * Both file descriptors are handed over to the renderer with SCM_RIGHTS
+ * on a UNIX socket, together with a SERingHello describing the layout:
+ * fds[0] is the shared memory segment, fds[1] the doorbell.
+ */
+
+#define SE_RING_MAGIC       0x53455247  /* "SERG" */
+#define SE_RING_VERSION     1
+#define SE_RING_CACHELINE   64
+
+typedef struct SERingShared {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t nr_entries;
+    uint8_t pad0[SE_RING_CACHELINE - 4 * sizeof(uint32_t)];
+    uint32_t head;      /* written by QEMU */
+    uint8_t pad1[SE_RING_CACHELINE - sizeof(uint32_t)];
+    uint32_t tail;      /* written by the renderer */
+    uint8_t pad2[SE_RING_CACHELINE - sizeof(uint32_t)];
+} SERingShared;
+
+typedef struct SERingHello {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t nr_entries;
+    uint64_t map_size;
+} SERingHello;
+
+typedef struct SERing {
+    SERingShared *shared;
+    uint8_t *entries;
+    size_t map_size;
+    int mem_fd;
+    int sock_fd;
+    EventNotifier doorbell;
+
+    uint32_t entry_size;
+    uint32_t mask;
+    uint32_t head;          /* next slot to fill */
+    uint32_t published;     /* last head made visible to the consumer */
+    uint32_t high_water;
+
+    /* Entries that did not fit in the ring, oldest first */
+    GByteArray *backlog;
+
+    uint64_t dropped;
+} SERing;
+
+int se_ring_init(SERing *r, const char *path, uint32_t nr_entries,
+                 uint32_t entry_size, Error **errp);
+void se_ring_cleanup(SERing *r);
+bool se_ring_push(SERing *r, const void *entry);
+void se_ring_flush(SERing *r);
+bool se_ring_busy(SERing *r);
+bool se_ring_drain(SERing *r);
+
+#endif // SPRITE_ENGINE_RING_H
@@ -28,7 +28,10 @@
 #include "hw/ptimer.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "qemu/atomic.h"
 
+#include "hw/sprite-engine/sprite_engine_chr.h"
 #include "hw/sprite-engine/sprite_engine_vsync_counter.h"
 
 #define D(x)
@@ -70,18 +73,25 @@ struct timerblock
     qemu_irq irq;
     uint32_t freq_hz;
     struct vsync_timer timer;
+    uint32_t port;
     int sockd;
-    bool vsync_count_init;
+
+    // Character device used instead of the TCP connection when set
+    CharDriverState *chr;
+    SEChrOut out;
+
+    // Frame number, read locklessly by the sprite engine
+    uint32_t vsync_count;
+
+    // Deterministic mode: vsync driven straight off QEMU_CLOCK_VIRTUAL
+    bool deterministic;
+    QEMUTimer *frame_timer;
+    int64_t next_frame_ns;
 };
 
 
 static void timer_update_irq(struct timerblock *t)
 {
-    // Uses a lazy initialization scheme
-    if (!t->vsync_count_init) {
-        init_sprite_engine_vsync_count();
-        t->vsync_count_init = true;
-    }
     struct VSyncCmd {
         uint16_t magic;
         uint32_t id;
@@ -96,13 +106,36 @@ static void timer_update_irq(struct timerblock *t)
         .id    = sync_count
     };
 
-    // int log = open("/tmp/se-vsync.log", O_CREAT | O_RDWR | O_APPEND, 0777);
-    // dprintf(log, "vsync: %d\n", sync_count);
     // Notify server of vsync
-    send(t->sockd, &cmd, sizeof(struct VSyncCmd), 0);
+    if (t->chr) {
+        se_chr_out_write(&t->out, &cmd, sizeof(struct VSyncCmd));
+    } else if (t->sockd != -1) {
+        send(t->sockd, &cmd, sizeof(struct VSyncCmd), 0);
+    }
 
     inc_sprite_engine_vsync_count();
-    // close(log);
+    sprite_engine_vsync_notify(get_sprite_engine_vsync_count());
+}
+
+static int64_t se_vsync_period_ns(struct timerblock *t)
+{
+    // Same period as the ptimer: 1000 ticks of freq_hz
+    return muldiv64(1000, get_ticks_per_sec(), t->freq_hz);
+}
+
+/*
+ * In deterministic mode the vsync is raised from the QEMU_CLOCK_VIRTUAL
+ * timer callback itself rather than from a bottom half, and deadlines are
+ * absolute multiples of the period.  With -icount the frame boundaries
+ * then land on the same guest instruction on every run.
+ */
+static void frame_timer_hit(void *opaque)
+{
+    struct timerblock *t = opaque;
+
+    timer_update_irq(t);
+    t->next_frame_ns += se_vsync_period_ns(t);
+    timer_mod(t->frame_timer, t->next_frame_ns);
 }
 
 static void timer_enable(struct vsync_timer *xt)
@@ -125,6 +158,28 @@ static void timer_hit(void *opaque)
     timer_update_irq(t);
 }
 
+static void se_vsync_connect(struct timerblock *t)
+{
+    struct sockaddr_in server;
+
+    t->sockd = -1;
+    int sockd = socket(PF_INET, SOCK_STREAM, 0);
+    if (sockd == -1) {
+        return;
+    }
+
+    memset(&server, 0, sizeof(struct sockaddr_in));
+    server.sin_addr.s_addr = inet_addr("127.0.0.1");
+    server.sin_family = PF_INET;
+    server.sin_port = htons(t->port);
+    int rv = connect(sockd, (struct sockaddr*) &server, sizeof(struct sockaddr));
+    if (rv != 0) {
+        close(sockd);
+        return;
+    }
+    t->sockd = sockd;
+}
+
 static void se_vsync_realize(DeviceState *dev, Error **errp)
 {
     struct timerblock *t = SE_VSYNC(dev);
@@ -133,39 +188,66 @@ static void se_vsync_realize(DeviceState *dev, Error **errp)
     xt->bh = qemu_bh_new(timer_hit, xt);
     xt->ptimer = ptimer_init(xt->bh);
     ptimer_set_freq(xt->ptimer, t->freq_hz);
+    t->frame_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, frame_timer_hit, t);
+
+    sprite_engine_vsync_set_counter(&t->vsync_count);
+
+    if (t->chr) {
+        t->sockd = -1;
+        se_chr_out_init(&t->out, t->chr);
+    } else {
+        se_vsync_connect(t);
+    }
 
     // Enable timer
-    timer_enable(&t->timer);
+    if (t->deterministic) {
+        t->next_frame_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                           se_vsync_period_ns(t);
+        timer_mod(t->frame_timer, t->next_frame_ns);
+    } else {
+        timer_enable(&t->timer);
+    }
 }
 
 static void se_vsync_init(Object *obj)
 {
-    struct sockaddr_in server;
     struct timerblock *t = SE_VSYNC(obj);
 
     // A single IRQ, to connect to cpu IRQ line
     sysbus_init_irq(SYS_BUS_DEVICE(obj), &t->irq);
+}
 
-    int sockd = socket(PF_INET, SOCK_STREAM, 0);
-    if (sockd == -1) {
-        return;
-    }
+static int se_vsync_post_load(void *opaque, int version_id)
+{
+    struct timerblock *t = opaque;
 
-    memset(&server, 0, sizeof(struct sockaddr_in));
-    server.sin_addr.s_addr = inet_addr("127.0.0.1");
-    server.sin_family = PF_INET;
-    server.sin_port = htons(1990);
-    int rv = connect(sockd, (struct sockaddr*) &server, sizeof(struct sockaddr));
-    if (rv != 0) {
-        return;
+    if (!t->chr && t->sockd == -1) {
+        se_vsync_connect(t);
     }
-    t->sockd = sockd;
-    t->vsync_count_init = false;
+    return 0;
 }
 
+static const VMStateDescription vmstate_se_vsync = {
+    .name = TYPE_SE_VSYNC,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = se_vsync_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(vsync_count, struct timerblock),
+        VMSTATE_PTIMER(timer.ptimer, struct timerblock),
+        VMSTATE_TIMER_PTR(frame_timer, struct timerblock),
+        VMSTATE_INT64(next_frame_ns, struct timerblock),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static Property se_vsync_properties[] = {
     DEFINE_PROP_UINT32("clock-frequency", struct timerblock, freq_hz,
                                                                 1000000),
+    DEFINE_PROP_BOOL("deterministic", struct timerblock, deterministic,
+                     false),
+    DEFINE_PROP_CHR("chardev", struct timerblock, chr),
+    DEFINE_PROP_UINT32("port", struct timerblock, port, 1990),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -175,6 +257,7 @@ static void se_vsync_class_init(ObjectClass *klass, void *data)
 
     dc->realize = se_vsync_realize;
     dc->props = se_vsync_properties;
+    dc->vmsd = &vmstate_se_vsync;
 }
 
 static const TypeInfo xilinx_timer_info = {
@@ -1,28 +1,30 @@
 #include "hw/sprite-engine/sprite_engine_vsync_counter.h"
 
-#include "qemu/thread.h"
+#include "qemu/atomic.h"
 
 
-// count/lock pair
-static uint32_t vsync_count;
-static QemuMutex count_lock;
+// Points at the frame counter of the vsync device, set before the guest runs
+static uint32_t *vsync_count;
 
-void init_sprite_engine_vsync_count() {
-    qemu_mutex_init(&count_lock);
-    vsync_count = 0;
+void sprite_engine_vsync_set_counter(uint32_t *count) {
+    vsync_count = count;
 }
 
 int get_sprite_engine_vsync_count() {
-    uint32_t ret = 0;
-    qemu_mutex_lock(&count_lock);
-    ret = vsync_count;
-    qemu_mutex_unlock(&count_lock);
-
-    return ret;
+    return vsync_count ? atomic_read(vsync_count) : 0;
 }
 
 void inc_sprite_engine_vsync_count() {
-    qemu_mutex_lock(&count_lock);
-    vsync_count++;
-    qemu_mutex_unlock(&count_lock);
+    atomic_inc(vsync_count);
+}
+
+static NotifierList vsync_notifiers =
+    NOTIFIER_LIST_INITIALIZER(vsync_notifiers);
+
+void sprite_engine_vsync_add_notifier(Notifier *notifier) {
+    notifier_list_add(&vsync_notifiers, notifier);
+}
+
+void sprite_engine_vsync_notify(uint32_t count) {
+    notifier_list_notify(&vsync_notifiers, &count);
 }
@@ -2,9 +2,17 @@
 #define SPRITE_ENGINE_VSYNC_COUNTER_H
 
 #include "qemu/main-loop.h"
+#include "qemu/notify.h"
 
-void init_sprite_engine_vsync_count(void);
+// The counter itself lives in the vsync device, which registers it here
+void sprite_engine_vsync_set_counter(uint32_t *count);
 int get_sprite_engine_vsync_count(void);
 void inc_sprite_engine_vsync_count(void);
 
+// Notifiers are run on every vsync edge, after the counter has been
+// incremented; data points at the number of frames completed so far, the
+// one ending at this edge included
+void sprite_engine_vsync_add_notifier(Notifier *notifier);
+void sprite_engine_vsync_notify(uint32_t count);
+
 #endif //SPRITE_ENGINE_VSYNC_COUNTER_H
@@ -0,0 +1,406 @@
+/*
+ * Compact wire format for sprite engine commands.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "qemu-common.h"
+#include "qemu/bswap.h"
+#include "hw/sprite-engine/sprite_engine_wire.h"
+
+/* opcode + index + mask + every OAM field */
+#define SE_WIRE_OAM_RECORD_MAX  11
+/* opcode + chunk + pixel_y + pixel_x + count + first pixel */
+#define SE_WIRE_VRAM_RUN_HDR    7
+
+void se_wire_encoder_init(SEWireEncoder *enc, size_t size)
+{
+    assert(size >= SE_WIRE_HEADER_SIZE + SE_WIRE_RECORD_MAX);
+    enc->buf = g_malloc(size);
+    enc->size = size;
+    se_wire_encoder_reset(enc);
+}
+
+void se_wire_encoder_cleanup(SEWireEncoder *enc)
+{
+    g_free(enc->buf);
+    enc->buf = NULL;
+}
+
+void se_wire_encoder_reset(SEWireEncoder *enc)
+{
+    enc->len = 0;
+    enc->run_open = false;
+    enc->keyframe = true;
+    memset(enc->oam, 0, sizeof(enc->oam));
+}
+
+static uint8_t se_wire_oam_flags(const struct SECommandUpdateOAM *oam)
+{
+    return (oam->enable ? 1 : 0) | (oam->flip_x ? 2 : 0) |
+           (oam->flip_y ? 4 : 0) | (oam->transpose ? 8 : 0);
+}
+
+static unsigned se_wire_oam_delta(const SEWireOAMState *prev,
+                                  const struct SECommandUpdateOAM *oam)
+{
+    unsigned mask = 0;
+
+    if (!prev->valid) {
+        return SE_WIRE_OAM_ALL;
+    }
+    if (se_wire_oam_flags(&prev->oam) != se_wire_oam_flags(oam)) {
+        mask |= SE_WIRE_OAM_FLAGS;
+    }
+    if (prev->oam.palette != oam->palette) {
+        mask |= SE_WIRE_OAM_PALETTE;
+    }
+    if (prev->oam.x_offset != oam->x_offset) {
+        mask |= SE_WIRE_OAM_X;
+    }
+    if (prev->oam.y_offset != oam->y_offset) {
+        mask |= SE_WIRE_OAM_Y;
+    }
+    if (prev->oam.sprite_size != oam->sprite_size) {
+        mask |= SE_WIRE_OAM_SIZE;
+    }
+    if (prev->oam.sprite != oam->sprite) {
+        mask |= SE_WIRE_OAM_SPRITE;
+    }
+    return mask;
+}
+
+/* Try to extend the open VRAM run with one more pixel */
+static bool se_wire_extend_run(SEWireEncoder *enc,
+                               const struct SECommandUpdateVRAM *vram)
+{
+    uint8_t *run = enc->buf + enc->run_offset;
+    uint8_t count = run[5];
+
+    if (!enc->run_open ||
+        lduw_le_p(run + 1) != vram->chunk ||
+        run[3] != vram->pixel_y ||
+        run[4] + count != vram->pixel_x ||
+        count >= SE_WIRE_VRAM_RUN_MAX) {
+        return false;
+    }
+    if (count & 1) {
+        enc->buf[enc->len - 1] |= (vram->p_data & 0xf) << 4;
+    } else {
+        if (enc->len + 1 > enc->size) {
+            return false;
+        }
+        enc->buf[enc->len++] = vram->p_data & 0xf;
+    }
+    run[5] = count + 1;
+    return true;
+}
+
+bool se_wire_encode(SEWireEncoder *enc, const union SECommand *cmd,
+                    uint32_t vsync_count)
+{
+    uint8_t *p;
+
+    if (enc->len == 0) {
+        enc->len = SE_WIRE_HEADER_SIZE;
+        enc->vsync_count = vsync_count;
+    } else if (enc->vsync_count != vsync_count) {
+        return false;
+    }
+
+    if (cmd->type == UPDATE_VRAM) {
+        const struct SECommandUpdateVRAM *vram = &cmd->update_vram;
+
+        if (se_wire_extend_run(enc, vram)) {
+            return true;
+        }
+        if (enc->len + SE_WIRE_VRAM_RUN_HDR > enc->size) {
+            return false;
+        }
+        enc->run_offset = enc->len;
+        enc->run_open = true;
+        p = enc->buf + enc->len;
+        p[0] = SE_WIRE_VRAM_RUN;
+        stw_le_p(p + 1, vram->chunk);
+        p[3] = vram->pixel_y;
+        p[4] = vram->pixel_x;
+        p[5] = 1;
+        p[6] = vram->p_data & 0xf;
+        enc->len += SE_WIRE_VRAM_RUN_HDR;
+        return true;
+    }
+
+    if (enc->len + SE_WIRE_OAM_RECORD_MAX > enc->size) {
+        return false;
+    }
+    enc->run_open = false;
+    p = enc->buf + enc->len;
+
+    switch (cmd->type) {
+    case UPDATE_OAM: {
+        const struct SECommandUpdateOAM *oam = &cmd->update_oam;
+        SEWireOAMState *prev = &enc->oam[oam->oam_index];
+        unsigned mask = se_wire_oam_delta(prev, oam);
+
+        if (!mask) {
+            /* Same as what the renderer already has */
+            return true;
+        }
+        *p++ = SE_WIRE_OAM;
+        *p++ = oam->oam_index;
+        *p++ = mask;
+        if (mask & SE_WIRE_OAM_FLAGS) {
+            *p++ = se_wire_oam_flags(oam);
+        }
+        if (mask & SE_WIRE_OAM_PALETTE) {
+            *p++ = oam->palette;
+        }
+        if (mask & SE_WIRE_OAM_X) {
+            stw_le_p(p, oam->x_offset);
+            p += 2;
+        }
+        if (mask & SE_WIRE_OAM_Y) {
+            stw_le_p(p, oam->y_offset);
+            p += 2;
+        }
+        if (mask & SE_WIRE_OAM_SIZE) {
+            *p++ = oam->sprite_size;
+        }
+        if (mask & SE_WIRE_OAM_SPRITE) {
+            *p++ = oam->sprite;
+        }
+        prev->valid = true;
+        prev->oam = *oam;
+        break;
+    }
+    case SET_PRIORITY_CTRL:
+        *p++ = SE_WIRE_PRIORITY;
+        *p++ = cmd->set_priority_control.iprctl;
+        break;
+    case UPDATE_CRAM:
+        *p++ = SE_WIRE_CRAM;
+        *p++ = cmd->update_cram.cram_index;
+        *p++ = (cmd->update_cram.palette_index << 4) |
+               (cmd->update_cram.user & 0xf);
+        *p++ = cmd->update_cram.red;
+        *p++ = cmd->update_cram.green;
+        *p++ = cmd->update_cram.blue;
+        break;
+    default:
+        abort();
+    }
+    enc->len = p - enc->buf;
+    return true;
+}
+
+size_t se_wire_encoder_finish(SEWireEncoder *enc)
+{
+    size_t len = enc->len;
+
+    enc->len = 0;
+    enc->run_open = false;
+    if (len <= SE_WIRE_HEADER_SIZE) {
+        return 0;
+    }
+
+    stw_le_p(enc->buf, SE_WIRE_MAGIC);
+    enc->buf[2] = SE_WIRE_VERSION;
+    enc->buf[3] = enc->keyframe ? SE_WIRE_F_KEYFRAME : 0;
+    stl_le_p(enc->buf + 4, len - SE_WIRE_HEADER_SIZE);
+    stl_le_p(enc->buf + 8, enc->vsync_count);
+    enc->keyframe = false;
+    return len;
+}
+
+void se_wire_decoder_init(SEWireDecoder *dec)
+{
+    memset(dec->oam, 0, sizeof(dec->oam));
+}
+
+static int se_wire_oam_field_size(unsigned bit)
+{
+    return (bit == SE_WIRE_OAM_X || bit == SE_WIRE_OAM_Y) ? 2 : 1;
+}
+
+static ssize_t se_wire_decode_oam(SEWireDecoder *dec, const uint8_t *p,
+                                  const uint8_t *end, uint32_t vsync_count,
+                                  SEWireCommandFunc *func, void *opaque)
+{
+    const uint8_t *start = p;
+    union SECommand cmd;
+    struct SECommandUpdateOAM *oam;
+    SEWireOAMState *state;
+    unsigned mask, bit;
+    int need = 0;
+
+    if (end - p < 2) {
+        return -1;
+    }
+    state = &dec->oam[p[0]];
+    mask = p[1];
+    if (mask & ~SE_WIRE_OAM_ALL) {
+        return -1;
+    }
+    for (bit = 1; bit <= SE_WIRE_OAM_SPRITE; bit <<= 1) {
+        if (mask & bit) {
+            need += se_wire_oam_field_size(bit);
+        }
+    }
+    if (end - p < 2 + need) {
+        return -1;
+    }
+
+    oam = &state->oam;
+    if (!state->valid) {
+        memset(oam, 0, sizeof(*oam));
+        state->valid = true;
+    }
+    oam->type = UPDATE_OAM;
+    oam->oam_index = p[0];
+    p += 2;
+    if (mask & SE_WIRE_OAM_FLAGS) {
+        oam->enable = (*p & 1) != 0;
+        oam->flip_x = (*p & 2) != 0;
+        oam->flip_y = (*p & 4) != 0;
+        oam->transpose = (*p & 8) != 0;
+        p++;
+    }
+    if (mask & SE_WIRE_OAM_PALETTE) {
+        oam->palette = *p++;
+    }
+    if (mask & SE_WIRE_OAM_X) {
+        oam->x_offset = lduw_le_p(p);
+        p += 2;
+    }
+    if (mask & SE_WIRE_OAM_Y) {
+        oam->y_offset = lduw_le_p(p);
+        p += 2;
+    }
+    if (mask & SE_WIRE_OAM_SIZE) {
+        oam->sprite_size = *p++;
+    }
+    if (mask & SE_WIRE_OAM_SPRITE) {
+        oam->sprite = *p++;
+    }
+    oam->vsync_count = vsync_count;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.update_oam = *oam;
+    func(opaque, &cmd);
+    return p - start;
+}
+
+static ssize_t se_wire_decode_vram_run(const uint8_t *p, const uint8_t *end,
+                                       SEWireCommandFunc *func, void *opaque)
+{
+    union SECommand cmd;
+    unsigned count, i;
+
+    if (end - p < 5) {
+        return -1;
+    }
+    count = p[4];
+    if (count == 0 || count > SE_WIRE_VRAM_RUN_MAX ||
+        end - p < 5 + (count + 1) / 2) {
+        return -1;
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.update_vram.type = UPDATE_VRAM;
+    cmd.update_vram.chunk = lduw_le_p(p);
+    cmd.update_vram.pixel_y = p[2];
+    for (i = 0; i < count; i++) {
+        uint8_t data = p[5 + i / 2];
+
+        cmd.update_vram.pixel_x = p[3] + i;
+        cmd.update_vram.p_data = (i & 1) ? data >> 4 : data & 0xf;
+        func(opaque, &cmd);
+    }
+    return 5 + (count + 1) / 2;
+}
+
+ssize_t se_wire_decode(SEWireDecoder *dec, const uint8_t *buf, size_t len,
+                       SEWireCommandFunc *func, void *opaque)
+{
+    const uint8_t *p, *end;
+    union SECommand cmd;
+    uint32_t payload, vsync_count;
+    ssize_t ret;
+
+    if (len < SE_WIRE_HEADER_SIZE) {
+        return 0;
+    }
+    if (lduw_le_p(buf) != SE_WIRE_MAGIC || buf[2] != SE_WIRE_VERSION) {
+        return -1;
+    }
+    payload = ldl_le_p(buf + 4);
+    if (len - SE_WIRE_HEADER_SIZE < payload) {
+        return 0;
+    }
+    vsync_count = ldl_le_p(buf + 8);
+    if (buf[3] & SE_WIRE_F_KEYFRAME) {
+        se_wire_decoder_init(dec);
+    }
+
+    p = buf + SE_WIRE_HEADER_SIZE;
+    end = p + payload;
+    while (p < end) {
+        uint8_t op = *p++;
+
+        memset(&cmd, 0, sizeof(cmd));
+        switch (op) {
+        case SE_WIRE_OAM:
+            ret = se_wire_decode_oam(dec, p, end, vsync_count, func, opaque);
+            break;
+        case SE_WIRE_PRIORITY:
+            if (end - p < 1) {
+                return -1;
+            }
+            cmd.set_priority_control.type = SET_PRIORITY_CTRL;
+            cmd.set_priority_control.iprctl = p[0] != 0;
+            func(opaque, &cmd);
+            ret = 1;
+            break;
+        case SE_WIRE_CRAM:
+            if (end - p < 5) {
+                return -1;
+            }
+            cmd.update_cram.type = UPDATE_CRAM;
+            cmd.update_cram.cram_index = p[0];
+            cmd.update_cram.palette_index = p[1] >> 4;
+            cmd.update_cram.user = p[1] & 0xf;
+            cmd.update_cram.red = p[2];
+            cmd.update_cram.green = p[3];
+            cmd.update_cram.blue = p[4];
+            func(opaque, &cmd);
+            ret = 5;
+            break;
+        case SE_WIRE_VRAM_RUN:
+            ret = se_wire_decode_vram_run(p, end, func, opaque);
+            break;
+        default:
+            return -1;
+        }
+        if (ret < 0) {
+            return -1;
+        }
+        p += ret;
+    }
+    return SE_WIRE_HEADER_SIZE + payload;
+}
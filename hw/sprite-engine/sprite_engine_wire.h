@@ -0,0 +1,121 @@
+#ifndef SPRITE_ENGINE_WIRE_H
+#define SPRITE_ENGINE_WIRE_H
+
+#include "hw/sprite-engine/sprite_engine_commands.h"
+
+/*
+ * Compact wire format for sprite engine commands.
+ *
+ * All multi-byte fields are little endian.  Commands are grouped in
+ * packets, each starting with a fixed header:
+ *
+ *   u16 magic (SE_WIRE_MAGIC)
+ *   u8  version (SE_WIRE_VERSION)
+ *   u8  flags (SE_WIRE_F_*)
+ *   u32 length of the records that follow, in bytes
+ *   u32 vsync count shared by every record of the packet
+ *
+ * followed by records, each introduced by a one byte opcode:
+ *
+ *   SE_WIRE_OAM       u8 oam_index, u8 field mask (SE_WIRE_OAM_*), then
+ *                     only the fields set in the mask, in mask bit order:
+ *                       flags u8 (enable, flip_x, flip_y, transpose)
+ *                       palette u8, x_offset u16, y_offset u16,
+ *                       sprite_size u8, sprite u8
+ *                     Fields missing from the mask keep the value they had
+ *                     in the last record for the same oam_index.
+ *   SE_WIRE_PRIORITY  u8 iprctl
+ *   SE_WIRE_CRAM      u8 cram_index, u8 palette_index << 4 | user,
+ *                     u8 red, u8 green, u8 blue
+ *   SE_WIRE_VRAM_RUN  u16 chunk, u8 pixel_y, u8 pixel_x, u8 count, then
+ *                     (count + 1) / 2 bytes of pixel data, two pixels per
+ *                     byte, low nibble first.  The run covers pixel_x up
+ *                     to pixel_x + count - 1 on the same row.
+ *
+ * A packet with SE_WIRE_F_KEYFRAME set resets the OAM history, so the
+ * first packet of a stream always carries it.
+ */
+
+#define SE_WIRE_MAGIC           0x5357
+#define SE_WIRE_VERSION         1
+#define SE_WIRE_HEADER_SIZE     12
+
+#define SE_WIRE_F_KEYFRAME      (1 << 0)
+
+#define SE_WIRE_OAM             0x01
+#define SE_WIRE_PRIORITY        0x02
+#define SE_WIRE_CRAM            0x03
+#define SE_WIRE_VRAM_RUN        0x04
+
+#define SE_WIRE_OAM_FLAGS       (1 << 0)
+#define SE_WIRE_OAM_PALETTE     (1 << 1)
+#define SE_WIRE_OAM_X           (1 << 2)
+#define SE_WIRE_OAM_Y           (1 << 3)
+#define SE_WIRE_OAM_SIZE        (1 << 4)
+#define SE_WIRE_OAM_SPRITE      (1 << 5)
+#define SE_WIRE_OAM_ALL         0x3f
+
+#define SE_WIRE_OAM_SLOTS       256
+#define SE_WIRE_VRAM_RUN_MAX    64
+
+/* Largest record: opcode + VRAM run header + a full row of pixels */
+#define SE_WIRE_RECORD_MAX      (6 + SE_WIRE_VRAM_RUN_MAX / 2)
+
+typedef struct SEWireOAMState {
+    bool valid;
+    struct SECommandUpdateOAM oam;
+} SEWireOAMState;
+
+typedef struct SEWireEncoder {
+    uint8_t *buf;
+    size_t size;
+    size_t len;             /* 0 when no packet is open */
+    bool keyframe;
+    uint32_t vsync_count;
+
+    /* Open VRAM run, extended in place while writes stay contiguous */
+    size_t run_offset;
+    bool run_open;
+
+    SEWireOAMState oam[SE_WIRE_OAM_SLOTS];
+} SEWireEncoder;
+
+typedef struct SEWireDecoder {
+    SEWireOAMState oam[SE_WIRE_OAM_SLOTS];
+} SEWireDecoder;
+
+typedef void SEWireCommandFunc(void *opaque, const union SECommand *cmd);
+
+/*
+ * @size is the capacity of the packet buffer; it must be at least
+ * SE_WIRE_HEADER_SIZE + SE_WIRE_RECORD_MAX.
+ */
+void se_wire_encoder_init(SEWireEncoder *enc, size_t size);
+void se_wire_encoder_cleanup(SEWireEncoder *enc);
+void se_wire_encoder_reset(SEWireEncoder *enc);
+
+/*
+ * Append @cmd to the open packet.  Returns false if the packet has to be
+ * taken with se_wire_encoder_finish() first; the command was not added.
+ */
+bool se_wire_encode(SEWireEncoder *enc, const union SECommand *cmd,
+                    uint32_t vsync_count);
+
+/*
+ * Close the open packet.  Returns its length, or 0 if there was nothing
+ * to send.  The packet stays in enc->buf until the next se_wire_encode().
+ */
+size_t se_wire_encoder_finish(SEWireEncoder *enc);
+
+void se_wire_decoder_init(SEWireDecoder *dec);
+
+/*
+ * Decode one packet from @buf, calling @func for every command.  VRAM
+ * runs are expanded back into single pixel commands.  Returns the number
+ * of bytes consumed, 0 if @buf does not hold a complete packet yet, or
+ * -1 if the data is malformed.
+ */
+ssize_t se_wire_decode(SEWireDecoder *dec, const uint8_t *buf, size_t len,
+                       SEWireCommandFunc *func, void *opaque);
+
+#endif // SPRITE_ENGINE_WIRE_H
@@ -278,6 +278,9 @@ CPUArchState *cpu_copy(CPUArchState *env);
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf);
 void dump_opcount_info(FILE *f, fprintf_function cpu_fprintf);
+void tb_set_profile(bool enable);
+void dump_tb_profile(FILE *f, fprintf_function cpu_fprintf, int max_tbs);
+void dump_tlb_stats(FILE *f, fprintf_function cpu_fprintf);
 #endif /* !CONFIG_USER_ONLY */
 
 int cpu_memory_rw_debug(CPUState *cpu, target_ulong addr,
@@ -131,15 +131,56 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/* The TLB maps TARGET_PAGE_SIZE pages only.  Areas mapped by larger
+ * pages are remembered so that flushing a page inside one of them
+ * flushes the whole area; this many of them are kept apart before
+ * they start being merged.
+ */
+#define CPU_TLB_LARGE_PAGES 4
+
+typedef struct CPUTLBLargePage {
+    target_ulong addr;
+    target_ulong mask;
+} CPUTLBLargePage;
+
+typedef struct CPUTLBStats {
+    uint64_t fills;
+    uint64_t victim_hits;
+    uint64_t full_flushes;
+    uint64_t page_flushes;
+    uint64_t large_page_flushes;
+    /* full flushes of an MMU mode that had no entries */
+    uint64_t skipped_flushes;
+    /* flushes requested by another CPU and done on entry to cpu_exec */
+    uint64_t remote_flushes;
+} CPUTLBStats;
+
+/* Pages that other CPUs asked this one to flush.  Past this many the
+ * whole TLB of the MMU modes involved is flushed instead.
+ */
+#define CPU_TLB_PENDING_PAGES 16
+
+typedef struct CPUTLBPendingPage {
+    target_ulong addr;
+    uint32_t idxmap;
+} CPUTLBPendingPage;
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
     CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
     CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
     CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
     CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
-    target_ulong tlb_flush_addr;                                        \
-    target_ulong tlb_flush_mask;                                        \
+    CPUTLBLargePage tlb_large_pages[CPU_TLB_LARGE_PAGES];               \
+    /* Bit N set if tlb_table[N] and tlb_v_table[N] hold no entry. */   \
+    uint32_t tlb_clean;                                                 \
     target_ulong vtlb_index;                                            \
+    CPUTLBStats tlb_stats;                                              \
+    /* Flushes requested by other CPUs, see tlb_flush_pages_cpumask. */ \
+    CPUTLBPendingPage tlb_pending[CPU_TLB_PENDING_PAGES];               \
+    int tlb_nb_pending;                                                 \
+    /* Bit N set if all of MMU mode N is to be flushed. */              \
+    uint32_t tlb_pending_full;                                          \
 
 #else
 
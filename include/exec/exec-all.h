@@ -83,6 +83,9 @@ void cpu_exec_init(CPUState *cpu, Error **errp);
 void QEMU_NORETURN cpu_loop_exit(CPUState *cpu);
 void QEMU_NORETURN cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc);
 
+/* Bitmap of every MMU index, for tlb_flush_pages_cpumask() */
+#define TLB_ALL_MMUIDX ((1u << NB_MMU_MODES) - 1)
+
 #if !defined(CONFIG_USER_ONLY)
 bool qemu_in_vcpu_thread(void);
 void cpu_reload_memory_map(CPUState *cpu);
@@ -128,6 +131,28 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, ...);
  * MMU indexes.
  */
 void tlb_flush_by_mmuidx(CPUState *cpu, ...);
+/**
+ * tlb_flush_pages_cpumask:
+ * @cpus: bitmap of the cpu_index of the CPUs to flush, or NULL for all
+ * @pages: virtual addresses of the pages to flush
+ * @nb_pages: number of entries in @pages, or -1 to flush all entries
+ * @idxmap: bitmap of the MMU indexes to flush
+ *
+ * Flush a batch of pages from the TLB of several CPUs.  The calling CPU
+ * is flushed immediately; the others are flushed before they next run
+ * guest code, all of a CPU's requests being done in one go.  A batch too
+ * large to queue flushes the whole TLB of the @idxmap modes instead.
+ */
+void tlb_flush_pages_cpumask(const unsigned long *cpus,
+                             const target_ulong *pages, int nb_pages,
+                             uint32_t idxmap);
+/**
+ * tlb_flush_pending:
+ * @cpu: CPU about to run guest code
+ *
+ * Do the flushes other CPUs requested with tlb_flush_pages_cpumask().
+ */
+void tlb_flush_pending(CPUState *cpu);
 void tlb_set_page(CPUState *cpu, target_ulong vaddr,
                   hwaddr paddr, int prot,
                   int mmu_idx, target_ulong size);
@@ -154,12 +179,19 @@ static inline void tlb_flush_page_by_mmuidx(CPUState *cpu,
 static inline void tlb_flush_by_mmuidx(CPUState *cpu, ...)
 {
 }
+
+static inline void tlb_flush_pages_cpumask(const unsigned long *cpus,
+                                           const target_ulong *pages,
+                                           int nb_pages, uint32_t idxmap)
+{
+}
 #endif
 
 #define CODE_GEN_ALIGN           16 /* must be >= of the size of a icache line */
 
-#define CODE_GEN_PHYS_HASH_BITS     15
-#define CODE_GEN_PHYS_HASH_SIZE     (1 << CODE_GEN_PHYS_HASH_BITS)
+/* Initial size of the TB hash table, which grows as needed */
+#define CODE_GEN_HTABLE_BITS     15
+#define CODE_GEN_HTABLE_SIZE     (1 << CODE_GEN_HTABLE_BITS)
 
 /* Estimated block size for TB allocation.  */
 /* ??? The following is based on a 2015 survey of x86_64 host output.
@@ -191,11 +223,11 @@ struct TranslationBlock {
 #define CF_LAST_IO     0x8000 /* Last insn may be an IO access.  */
 #define CF_NOCACHE     0x10000 /* To be freed after execution */
 #define CF_USE_ICOUNT  0x20000
+#define CF_PROFILE     0x40000 /* Count executions in exec_count */
 
     void *tc_ptr;    /* pointer to the translated code */
     uint8_t *tc_search;  /* pointer to search data */
-    /* next matching tb for physical address. */
-    struct TranslationBlock *phys_hash_next;
+    uint64_t exec_count; /* executions so far, if CF_PROFILE */
     /* original tb when cflags has CF_NOCACHE */
     struct TranslationBlock *orig_tb;
     /* first and second physical page containing code. The lower bit
@@ -220,19 +252,49 @@ struct TranslationBlock {
 };
 
 #include "qemu/thread.h"
+#include "qemu/qht.h"
+
+/* The code buffer is split into regions, each with its own slice of
+   TBContext.tbs.  When the region being filled runs out of space, the
+   region whose TBs ran least recently is evicted and translation goes
+   on there, instead of flushing everything.  */
+#define CODE_GEN_MAX_REGIONS 8
+
+typedef struct TBRegion {
+    void *start;
+    void *end;
+    /* end of the generated code, when the region is not the current one */
+    void *ptr;
+    TranslationBlock *tbs;
+    int nb_tbs;
+    /* value of TBContext.generation when one of our TBs last ran */
+    unsigned int last_used;
+} TBRegion;
 
 typedef struct TBContext TBContext;
 
 struct TBContext {
 
     TranslationBlock *tbs;
-    TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
+    /* TBs by physical PC, looked up without tb_lock */
+    QHT htable;
     int nb_tbs;
+
+    TBRegion regions[CODE_GEN_MAX_REGIONS];
+    int nb_regions;
+    int cur_region;
+    /* each region holds up to 1 << region_tbs_bits TBs */
+    int region_tbs_bits;
+    /* bumped whenever the current region fills up */
+    unsigned int generation;
+    /* translate new TBs with CF_PROFILE */
+    bool profile;
     /* any access to the tbs or the page table must use this lock */
     QemuMutex tb_lock;
 
     /* statistics */
     int tb_flush_count;
+    int tb_region_evict_count;
     int tb_phys_invalidate_count;
 
     int tb_invalidated_flag;
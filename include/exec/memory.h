@@ -187,6 +187,9 @@ struct MemoryRegion {
     bool may_overlap;
     QTAILQ_HEAD(subregions, MemoryRegion) subregions;
     QTAILQ_ENTRY(MemoryRegion) subregions_link;
+    /* Aliases of this region, linked by alias_users_link */
+    QTAILQ_HEAD(alias_users, MemoryRegion) alias_users;
+    QTAILQ_ENTRY(MemoryRegion) alias_users_link;
     QTAILQ_HEAD(coalesced_ranges, CoalescedMemoryRange) coalesced;
     const char *name;
     uint8_t dirty_log_mask;
@@ -240,6 +243,11 @@ struct AddressSpace {
     /* Accessed via RCU.  */
     struct FlatView *current_map;
 
+    /* Parts of current_map to render again when the transaction ends */
+    struct AddrRange *dirty_ranges;
+    unsigned dirty_nb;
+    bool dirty_all;
+
     int ioeventfd_nb;
     struct MemoryRegionIoeventfd *ioeventfds;
     struct AddressSpaceDispatch *dispatch;
@@ -43,9 +43,17 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
            | (tmp & TB_JMP_ADDR_MASK));
 }
 
-static inline unsigned int tb_phys_hash_func(tb_page_addr_t pc)
+/* Hash for the TB hash table.  Collisions on cs_base are rare enough
+   that it is only compared, not hashed.  */
+static inline uint32_t tb_hash_func(tb_page_addr_t phys_pc, target_ulong pc,
+                                    uint64_t flags)
 {
-    return (pc >> 2) & (CODE_GEN_PHYS_HASH_SIZE - 1);
+    uint64_t h;
+
+    h = (uint64_t)phys_pc * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 29) ^ pc) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 31) ^ flags) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 32);
 }
 
 #endif
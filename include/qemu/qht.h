@@ -0,0 +1,120 @@
+/*
+ * QHT: a concurrent hash table with lock-free lookups
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_QHT_H
+#define QEMU_QHT_H 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "qemu/thread.h"
+
+typedef struct QHT QHT;
+typedef struct QHTStats QHTStats;
+
+/* Returns true if @obj is the object described by @userp.  */
+typedef bool (*qht_lookup_func_t)(const void *obj, const void *userp);
+typedef void (*qht_iter_func_t)(QHT *ht, void *obj, uint32_t hash,
+                                void *userp);
+
+struct QHT {
+    struct qht_map *map;
+    /* Serializes insertions, removals, resets and resizes.  */
+    QemuMutex lock;
+    unsigned int mode;
+};
+
+/* Double the number of buckets once the chains get long.  */
+#define QHT_MODE_AUTO_RESIZE 0x1
+
+struct QHTStats {
+    size_t head_buckets;
+    size_t used_head_buckets;
+    size_t entries;
+    /* Buckets in the longest chain, head bucket included.  */
+    size_t max_chain;
+};
+
+/**
+ * qht_init:
+ * @ht: The table to initialize.
+ * @n_elems: Number of entries the table should hold without growing.
+ * @mode: QHT_MODE_* flags.
+ */
+void qht_init(QHT *ht, size_t n_elems, unsigned int mode);
+
+/**
+ * qht_destroy:
+ * @ht: The table to destroy.
+ *
+ * Must not race with any other access to @ht, lookups included.
+ */
+void qht_destroy(QHT *ht);
+
+/**
+ * qht_insert:
+ * @ht: The table.
+ * @p: The object to insert, must not be NULL.
+ * @hash: Hash of the key of @p.
+ *
+ * Returns false, and leaves the table alone, if @p is already in it.
+ */
+bool qht_insert(QHT *ht, void *p, uint32_t hash);
+
+/**
+ * qht_remove:
+ * @ht: The table.
+ * @p: The object to remove.
+ * @hash: The hash @p was inserted with.
+ *
+ * Returns false if @p was not in the table.  Concurrent lookups may still
+ * return @p until they complete, so @p must only be freed after an RCU
+ * grace period.
+ */
+bool qht_remove(QHT *ht, const void *p, uint32_t hash);
+
+/**
+ * qht_lookup:
+ * @ht: The table.
+ * @func: Compares a candidate object with @userp.
+ * @userp: The key being looked up, passed to @func.
+ * @hash: Hash of the key.
+ *
+ * Returns the first object with hash @hash that @func accepts, or NULL.
+ * Does not take any lock and may run concurrently with updates, but it
+ * must be called inside an RCU read-side critical section.  @func may be
+ * called on objects that are being inserted or removed.
+ */
+void *qht_lookup(QHT *ht, qht_lookup_func_t func, const void *userp,
+                 uint32_t hash);
+
+/**
+ * qht_reset:
+ * @ht: The table.
+ *
+ * Remove every object from the table, keeping its size.
+ */
+void qht_reset(QHT *ht);
+
+/**
+ * qht_iter:
+ * @ht: The table.
+ * @func: Called on every object in the table.
+ * @userp: Passed to @func.
+ *
+ * @func runs with the table locked and must not modify it.
+ */
+void qht_iter(QHT *ht, qht_iter_func_t func, void *userp);
+
+/**
+ * qht_statistics:
+ * @ht: The table.
+ * @stats: Filled in with the current occupancy of the table.
+ */
+void qht_statistics(QHT *ht, QHTStats *stats);
+
+#endif
@@ -964,7 +964,8 @@ static void elf_core_copy_regs(target_elf_gregset_t *regs, const CPUMBState *env
     }
 
     for (i = 0; i < 6; i++) {
-        (*regs)[pos++] = tswapreg(env->sregs[i]);
+        (*regs)[pos++] = tswapreg(i == SR_MSR ? mb_cpu_read_msr(env)
+                                              : env->sregs[i]);
     }
 }
 
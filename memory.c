@@ -629,6 +629,213 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     return view;
 }
 
+/* Beyond this many separate dirty ranges, an address space is rendered
+ * again in full.
+ */
+#define ADDRESS_SPACE_DIRTY_RANGES 16
+
+static void address_space_add_dirty(AddressSpace *as, AddrRange range)
+{
+    if (as->dirty_all) {
+        return;
+    }
+    if (as->dirty_nb == ADDRESS_SPACE_DIRTY_RANGES) {
+        as->dirty_all = true;
+        return;
+    }
+    as->dirty_ranges = g_renew(AddrRange, as->dirty_ranges, as->dirty_nb + 1);
+    as->dirty_ranges[as->dirty_nb++] = range;
+}
+
+static void address_space_clear_dirty(AddressSpace *as)
+{
+    g_free(as->dirty_ranges);
+    as->dirty_ranges = NULL;
+    as->dirty_nb = 0;
+    as->dirty_all = false;
+}
+
+static bool address_space_is_dirty(AddressSpace *as)
+{
+    return as->dirty_all || as->dirty_nb;
+}
+
+/* Mark [@start, @end), in the coordinates of @mr, dirty in every address
+ * space where it is visible: up through the containers of @mr and through
+ * each alias that points to a region on the way.
+ */
+static void memory_region_mark_dirty_range(MemoryRegion *mr,
+                                           Int128 start, Int128 end,
+                                           bool check_enabled)
+{
+    AddressSpace *as;
+    MemoryRegion *alias;
+
+    if (check_enabled && !mr->enabled) {
+        return;
+    }
+
+    start = int128_max(start, int128_zero());
+    end = int128_min(end, mr->size);
+    if (int128_ge(start, end)) {
+        return;
+    }
+
+    QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+        if (as->root == mr) {
+            address_space_add_dirty(as,
+                                    addrrange_make(start,
+                                                   int128_sub(end, start)));
+        }
+    }
+
+    QTAILQ_FOREACH(alias, &mr->alias_users, alias_users_link) {
+        Int128 offset = int128_make64(alias->alias_offset);
+
+        memory_region_mark_dirty_range(alias, int128_sub(start, offset),
+                                       int128_sub(end, offset), true);
+    }
+
+    if (mr->container) {
+        Int128 addr = int128_make64(mr->addr);
+
+        memory_region_mark_dirty_range(mr->container, int128_add(start, addr),
+                                       int128_add(end, addr), true);
+    }
+}
+
+/* The way @mr renders is about to change, or has just changed: schedule
+ * the part of each address space that it covers to be rendered again.
+ * Changes that can move a region call this both before and after.
+ */
+static void memory_region_update_dirty(MemoryRegion *mr)
+{
+    memory_region_update_pending = true;
+    memory_region_mark_dirty_range(mr, int128_zero(), mr->size, false);
+}
+
+static void memory_region_update_all(void)
+{
+    AddressSpace *as;
+
+    memory_region_update_pending = true;
+    QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+        as->dirty_all = true;
+    }
+}
+
+static int addrrange_compare(const void *a, const void *b)
+{
+    const AddrRange *r1 = a, *r2 = b;
+
+    if (int128_lt(r1->start, r2->start)) {
+        return -1;
+    }
+    return int128_gt(r1->start, r2->start);
+}
+
+/* Sort the dirty ranges of @as and merge those that overlap or touch */
+static void address_space_merge_dirty(AddressSpace *as)
+{
+    AddrRange *r = as->dirty_ranges;
+    unsigned i, n = 0;
+
+    qsort(r, as->dirty_nb, sizeof(*r), addrrange_compare);
+    for (i = 0; i < as->dirty_nb; i++) {
+        if (n && int128_le(r[i].start, addrrange_end(r[n - 1]))) {
+            Int128 end = int128_max(addrrange_end(r[n - 1]),
+                                    addrrange_end(r[i]));
+
+            r[n - 1].size = int128_sub(end, r[n - 1].start);
+        } else {
+            r[n++] = r[i];
+        }
+    }
+    as->dirty_nb = n;
+}
+
+/* Copy to @view the parts of @old that are outside the sorted, disjoint
+ * @holes.
+ */
+static void flatview_copy_outside(FlatView *view, const FlatView *old,
+                                  const AddrRange *holes, unsigned nb_holes)
+{
+    unsigned h = 0;
+    FlatRange *fr;
+
+    FOR_EACH_FLAT_RANGE(fr, old) {
+        Int128 start = fr->addr.start;
+        Int128 end = addrrange_end(fr->addr);
+
+        while (int128_lt(start, end)) {
+            Int128 stop = end;
+            FlatRange piece;
+
+            while (h < nb_holes
+                   && int128_le(addrrange_end(holes[h]), start)) {
+                ++h;
+            }
+            if (h < nb_holes && int128_le(holes[h].start, start)) {
+                start = int128_min(addrrange_end(holes[h]), end);
+                continue;
+            }
+            if (h < nb_holes) {
+                stop = int128_min(stop, holes[h].start);
+            }
+
+            piece = *fr;
+            piece.offset_in_region +=
+                int128_get64(int128_sub(start, fr->addr.start));
+            piece.addr = addrrange_make(start, int128_sub(stop, start));
+            flatview_insert(view, view->nr, &piece);
+            start = stop;
+        }
+    }
+}
+
+/* Render again only the dirty parts of @as, keeping the rest of @old.
+ * render_memory_region only fills the gaps of the view, so rendering the
+ * whole tree clipped to each dirty range gives the same result as a full
+ * generate_memory_topology, while only visiting the regions that
+ * intersect the dirty ranges.
+ */
+static FlatView *generate_memory_topology_partial(AddressSpace *as,
+                                                  const FlatView *old)
+{
+    FlatView *view;
+    unsigned i;
+
+    address_space_merge_dirty(as);
+
+    view = g_new(FlatView, 1);
+    flatview_init(view);
+    flatview_copy_outside(view, old, as->dirty_ranges, as->dirty_nb);
+    for (i = 0; i < as->dirty_nb; i++) {
+        render_memory_region(view, as->root, int128_zero(),
+                             as->dirty_ranges[i], false);
+    }
+    flatview_simplify(view);
+
+    return view;
+}
+
+#ifdef CONFIG_DEBUG_MEMORY
+/* Check that @view, rendered only in the dirty ranges of @as, is the same
+ * as a full render, range by range.
+ */
+static void flatview_check_partial(AddressSpace *as, FlatView *view)
+{
+    FlatView *full = generate_memory_topology(as->root);
+    unsigned i;
+
+    assert(view->nr == full->nr);
+    for (i = 0; i < full->nr; i++) {
+        assert(flatrange_equal(&view->ranges[i], &full->ranges[i]));
+    }
+    flatview_unref(full);
+}
+#endif
+
 static void address_space_add_del_ioeventfds(AddressSpace *as,
                                              MemoryRegionIoeventfd *fds_new,
                                              unsigned fds_new_nb,
@@ -794,7 +1001,16 @@ static void address_space_update_topology_pass(AddressSpace *as,
 static void address_space_update_topology(AddressSpace *as)
 {
     FlatView *old_view = address_space_get_flatview(as);
-    FlatView *new_view = generate_memory_topology(as->root);
+    FlatView *new_view;
+
+    if (as->dirty_all || !as->root) {
+        new_view = generate_memory_topology(as->root);
+    } else {
+        new_view = generate_memory_topology_partial(as, old_view);
+#ifdef CONFIG_DEBUG_MEMORY
+        flatview_check_partial(as, new_view);
+#endif
+    }
 
     address_space_update_topology_pass(as, old_view, new_view, false);
     address_space_update_topology_pass(as, old_view, new_view, true);
@@ -826,21 +1042,50 @@ static void memory_region_clear_pending(void)
     ioeventfd_update_pending = false;
 }
 
+/* Listeners tied to an address space that has nothing to render again
+ * see no change, and so do not need begin/commit either.
+ */
+static bool memory_listener_needs_update(MemoryListener *listener)
+{
+    AddressSpace *as = listener->address_space_filter;
+
+    return !as || address_space_is_dirty(as);
+}
+
 void memory_region_transaction_commit(void)
 {
     AddressSpace *as;
+    MemoryListener *listener;
 
     assert(memory_region_transaction_depth);
     --memory_region_transaction_depth;
     if (!memory_region_transaction_depth) {
         if (memory_region_update_pending) {
-            MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
+            QTAILQ_FOREACH(listener, &memory_listeners, link) {
+                if (listener->begin &&
+                    memory_listener_needs_update(listener)) {
+                    listener->begin(listener);
+                }
+            }
 
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
-                address_space_update_topology(as);
+                if (address_space_is_dirty(as)) {
+                    address_space_update_topology(as);
+                } else if (ioeventfd_update_pending) {
+                    address_space_update_ioeventfds(as);
+                }
             }
 
-            MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
+            QTAILQ_FOREACH(listener, &memory_listeners, link) {
+                if (listener->commit &&
+                    memory_listener_needs_update(listener)) {
+                    listener->commit(listener);
+                }
+            }
+
+            QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+                address_space_clear_dirty(as);
+            }
         } else if (ioeventfd_update_pending) {
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
                 address_space_update_ioeventfds(as);
@@ -998,6 +1243,7 @@ static void memory_region_initfn(Object *obj)
     mr->global_locking = true;
     mr->destructor = memory_region_destructor_none;
     QTAILQ_INIT(&mr->subregions);
+    QTAILQ_INIT(&mr->alias_users);
     QTAILQ_INIT(&mr->coalesced);
 
     op = object_property_add(OBJECT(mr), "container",
@@ -1269,6 +1515,7 @@ void memory_region_init_alias(MemoryRegion *mr,
     memory_region_init(mr, owner, name, size);
     mr->alias = orig;
     mr->alias_offset = offset;
+    QTAILQ_INSERT_TAIL(&orig->alias_users, mr, alias_users_link);
 }
 
 void memory_region_init_rom_device(MemoryRegion *mr,
@@ -1318,8 +1565,25 @@ static void memory_region_finalize(Object *obj)
         MemoryRegion *subregion = QTAILQ_FIRST(&mr->subregions);
         memory_region_del_subregion(mr, subregion);
     }
+    /* An alias does not hold a reference to the region it points to, so
+     * it can outlive it.  Detach those that are left: they render nothing
+     * from now on, and their own finalize must not touch this list.
+     */
+    while (!QTAILQ_EMPTY(&mr->alias_users)) {
+        MemoryRegion *alias = QTAILQ_FIRST(&mr->alias_users);
+
+        if (alias->enabled) {
+            memory_region_update_dirty(alias);
+        }
+        QTAILQ_REMOVE(&mr->alias_users, alias, alias_users_link);
+        alias->alias = NULL;
+    }
     memory_region_transaction_commit();
 
+    if (mr->alias) {
+        QTAILQ_REMOVE(&mr->alias->alias_users, mr, alias_users_link);
+    }
+
     mr->destructor(mr);
     memory_region_clear_coalescing(mr);
     g_free((char *)mr->name);
@@ -1464,7 +1728,9 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_dirty(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -1513,7 +1779,9 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_dirty(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -1523,7 +1791,9 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_dirty(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -1776,7 +2046,9 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_dirty(subregion);
+    }
     memory_region_transaction_commit();
 }
 
@@ -1814,10 +2086,12 @@ void memory_region_del_subregion(MemoryRegion *mr,
 {
     memory_region_transaction_begin();
     assert(subregion->container == mr);
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_dirty(subregion);
+    }
     subregion->container = NULL;
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
 
@@ -1828,7 +2102,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
-    memory_region_update_pending = true;
+    memory_region_update_dirty(mr);
     memory_region_transaction_commit();
 }
 
@@ -1843,8 +2117,9 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
         return;
     }
     memory_region_transaction_begin();
+    memory_region_update_dirty(mr);
     mr->size = s;
-    memory_region_update_pending = true;
+    memory_region_update_dirty(mr);
     memory_region_transaction_commit();
 }
 
@@ -1866,8 +2141,14 @@ static void memory_region_readd_subregion(MemoryRegion *mr)
 void memory_region_set_address(MemoryRegion *mr, hwaddr addr)
 {
     if (addr != mr->addr) {
+        memory_region_transaction_begin();
+        /* The old place; readding marks the new one.  */
+        if (mr->enabled) {
+            memory_region_update_dirty(mr);
+        }
         mr->addr = addr;
         memory_region_readd_subregion(mr);
+        memory_region_transaction_commit();
     }
 }
 
@@ -1881,7 +2162,9 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_dirty(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2009,7 +2292,7 @@ void memory_global_dirty_log_start(void)
 
     /* Refresh DIRTY_LOG_MIGRATION bit.  */
     memory_region_transaction_begin();
-    memory_region_update_pending = true;
+    memory_region_update_all();
     memory_region_transaction_commit();
 }
 
@@ -2019,7 +2302,7 @@ void memory_global_dirty_log_stop(void)
 
     /* Refresh DIRTY_LOG_MIGRATION bit.  */
     memory_region_transaction_begin();
-    memory_region_update_pending = true;
+    memory_region_update_all();
     memory_region_transaction_commit();
 
     MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
@@ -2100,6 +2383,9 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
     as->name = g_strdup(name ? name : "anonymous");
     address_space_init_dispatch(as);
+    as->dirty_ranges = NULL;
+    as->dirty_nb = 0;
+    as->dirty_all = true;
     memory_region_update_pending |= root->enabled;
     memory_region_transaction_commit();
 }
@@ -2115,6 +2401,7 @@ static void do_address_space_destroy(AddressSpace *as)
     }
 
     flatview_unref(as->current_map);
+    g_free(as->dirty_ranges);
     g_free(as->name);
     g_free(as->ioeventfds);
     memory_region_unref(as->root);
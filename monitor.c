@@ -986,6 +986,25 @@ static void hmp_info_jit(Monitor *mon, const QDict *qdict)
     dump_drift_info((FILE *)mon, monitor_fprintf);
 }
 
+static void hmp_info_jit_profile(Monitor *mon, const QDict *qdict)
+{
+    if (!tcg_enabled()) {
+        monitor_printf(mon, "TCG is not in use\n");
+        return;
+    }
+    dump_tb_profile((FILE *)mon, monitor_fprintf,
+                    qdict_get_try_int(qdict, "count", 20));
+}
+
+static void hmp_info_tlb_stats(Monitor *mon, const QDict *qdict)
+{
+    if (!tcg_enabled()) {
+        monitor_printf(mon, "TCG is not in use\n");
+        return;
+    }
+    dump_tlb_stats((FILE *)mon, monitor_fprintf);
+}
+
 static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info((FILE *)mon, monitor_fprintf);
@@ -1089,6 +1108,23 @@ static void hmp_singlestep(Monitor *mon, const QDict *qdict)
     }
 }
 
+static void hmp_jit_profile(Monitor *mon, const QDict *qdict)
+{
+    const char *option = qdict_get_try_str(qdict, "option");
+
+    if (!tcg_enabled()) {
+        monitor_printf(mon, "TCG is not in use\n");
+        return;
+    }
+    if (!option || !strcmp(option, "on")) {
+        tb_set_profile(true);
+    } else if (!strcmp(option, "off")) {
+        tb_set_profile(false);
+    } else {
+        monitor_printf(mon, "unexpected option %s\n", option);
+    }
+}
+
 static void hmp_gdbserver(Monitor *mon, const QDict *qdict)
 {
     const char *device = qdict_get_try_str(qdict, "device");
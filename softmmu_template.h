@@ -134,6 +134,7 @@
             tmpiotlb = env->iotlb[mmu_idx][index];                            \
             env->iotlb[mmu_idx][index] = env->iotlb_v[mmu_idx][vidx];         \
             env->iotlb_v[mmu_idx][vidx] = tmpiotlb;                           \
+            env->tlb_stats.victim_hits++;                                     \
             break;                                                            \
         }                                                                     \
     }                                                                         \
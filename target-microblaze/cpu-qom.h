@@ -69,6 +69,8 @@ typedef struct MicroBlazeCPU {
         bool endi;
         char *version;
         uint8_t pvr;
+        bool superblocks;
+        bool unaligned_exceptions;
     } cfg;
 
     CPUMBState env;
@@ -83,6 +85,10 @@ static inline MicroBlazeCPU *mb_env_get_cpu(CPUMBState *env)
 
 #define ENV_OFFSET offsetof(MicroBlazeCPU, env)
 
+#ifndef CONFIG_USER_ONLY
+extern const struct VMStateDescription vmstate_mb_cpu;
+#endif
+
 void mb_cpu_do_interrupt(CPUState *cs);
 bool mb_cpu_exec_interrupt(CPUState *cs, int int_req);
 void mb_cpu_dump_state(CPUState *cpu, FILE *f, fprintf_function cpu_fprintf,
@@ -241,6 +241,9 @@ struct CPUMBState {
     uint32_t imm;
     uint32_t regs[33];
     uint32_t sregs[24];
+    /* MSR[C] as 0 or 1.  The carry bits of sregs[SR_MSR] are stale, use
+       mb_cpu_read_msr() and mb_cpu_write_msr() for the whole register.  */
+    uint32_t msr_c;
     float_status fp_status;
     /* Stack protectors. Yes, it's a hw feature.  */
     uint32_t slr, shr;
@@ -331,10 +334,25 @@ static inline void cpu_get_tb_cpu_state(CPUMBState *env, target_ulong *pc,
                  (env->sregs[SR_MSR] & (MSR_UM | MSR_VM | MSR_EE));
 }
 
+static inline uint32_t mb_cpu_read_msr(const CPUMBState *env)
+{
+    uint32_t msr = env->sregs[SR_MSR] & ~(MSR_C | MSR_CC);
+
+    return env->msr_c ? msr | MSR_C | MSR_CC : msr;
+}
+
+static inline void mb_cpu_write_msr(CPUMBState *env, uint32_t msr)
+{
+    env->msr_c = !!(msr & MSR_C);
+    env->sregs[SR_MSR] = msr;
+}
+
 #if !defined(CONFIG_USER_ONLY)
 void mb_cpu_unassigned_access(CPUState *cpu, hwaddr addr,
                               bool is_write, bool is_exec, int is_asi,
                               unsigned size);
+void mb_cpu_do_unaligned_access(CPUState *cs, vaddr addr, int is_write,
+                                int mmu_idx, uintptr_t retaddr);
 #endif
 
 #include "exec/exec-all.h"
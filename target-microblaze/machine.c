@@ -0,0 +1,84 @@
+/*
+ *  MicroBlaze virtual CPU state save/load support
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hw/hw.h"
+#include "hw/boards.h"
+
+/* Only the tlb rams and the control registers are saved, the lookup index
+   and the fill records are derived from them.  The c_mmu* fields follow
+   the cpu configuration and are set up again by reset.  */
+static const VMStateDescription vmstate_mb_mmu = {
+    .name = "cpu/mmu",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(rams[RAM_TAG], struct microblaze_mmu,
+                             TLB_ENTRIES),
+        VMSTATE_UINT32_ARRAY(rams[RAM_DATA], struct microblaze_mmu,
+                             TLB_ENTRIES),
+        VMSTATE_UINT8_ARRAY(tids, struct microblaze_mmu, TLB_ENTRIES),
+        VMSTATE_UINT32_ARRAY(regs, struct microblaze_mmu, 8),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+/* fp_status is not saved: the rounding mode never changes and the
+   exception flags are cleared before every fpu helper.  */
+static const VMStateDescription vmstate_mb_env = {
+    .name = "env",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(debug, CPUMBState),
+        VMSTATE_UINT32(btaken, CPUMBState),
+        VMSTATE_UINT32(btarget, CPUMBState),
+        VMSTATE_UINT32(bimm, CPUMBState),
+        VMSTATE_UINT32(imm, CPUMBState),
+        VMSTATE_UINT32_ARRAY(regs, CPUMBState, 33),
+        VMSTATE_UINT32_ARRAY(sregs, CPUMBState, 24),
+        VMSTATE_UINT32(msr_c, CPUMBState),
+        VMSTATE_UINT32(slr, CPUMBState),
+        VMSTATE_UINT32(shr, CPUMBState),
+        VMSTATE_UINT32(res_addr, CPUMBState),
+        VMSTATE_UINT32(res_val, CPUMBState),
+        VMSTATE_UINT32(iflags, CPUMBState),
+        VMSTATE_STRUCT(mmu, CPUMBState, 1, vmstate_mb_mmu,
+                       struct microblaze_mmu),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static int mb_cpu_post_load(void *opaque, int version_id)
+{
+    MicroBlazeCPU *cpu = opaque;
+
+    mmu_rebuild(&cpu->env.mmu);
+    tlb_flush(CPU(cpu), 1);
+    return 0;
+}
+
+const VMStateDescription vmstate_mb_cpu = {
+    .name = "cpu",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = mb_cpu_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_CPU(),
+        VMSTATE_STRUCT(env, MicroBlazeCPU, 1, vmstate_mb_env, CPUMBState),
+        VMSTATE_END_OF_LIST()
+    }
+};
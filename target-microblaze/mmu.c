@@ -32,43 +32,113 @@ static unsigned int tlb_decode_size(unsigned int f)
     return sizes[f];
 }
 
+static inline unsigned int mmu_index_hash(uint32_t vaddr, unsigned int sz)
+{
+    uint32_t pn = vaddr >> (10 + 2 * sz);
+
+    return (pn ^ (pn >> 6)) & (TLB_INDEX_BUCKETS - 1);
+}
+
+static void mmu_index_del(struct microblaze_mmu *mmu, unsigned int idx)
+{
+    uint32_t t = mmu->rams[RAM_TAG][idx];
+    unsigned int sz;
+
+    if (!(t & TLB_VALID))
+        return;
+
+    sz = (t & TLB_PAGESZ_MASK) >> 7;
+    mmu->index[sz][mmu_index_hash(t & TLB_EPN_MASK, sz)] &= ~(1ULL << idx);
+    mmu->index_used[sz]--;
+}
+
+static void mmu_index_add(struct microblaze_mmu *mmu, unsigned int idx)
+{
+    uint32_t t = mmu->rams[RAM_TAG][idx];
+    unsigned int sz;
+
+    if (!(t & TLB_VALID))
+        return;
+
+    sz = (t & TLB_PAGESZ_MASK) >> 7;
+    mmu->index[sz][mmu_index_hash(t & TLB_EPN_MASK, sz)] |= 1ULL << idx;
+    mmu->index_used[sz]++;
+}
+
+/* Record that the page at vaddr went into the QEMU TLB for mmu_idx,
+   translated through entry idx.  */
+void mmu_note_fill(struct microblaze_mmu *mmu, unsigned int idx,
+                   uint32_t vaddr, int mmu_idx)
+{
+    uint32_t *pages = mmu->fill_pages[idx];
+    unsigned int i, n = mmu->fill_count[idx];
+
+    if (n > TLB_FILL_PAGES)
+        return;
+
+    vaddr &= TARGET_PAGE_MASK;
+    for (i = 0; i < n; i++) {
+        if ((pages[i] & TARGET_PAGE_MASK) == vaddr) {
+            pages[i] |= 1 << mmu_idx;
+            return;
+        }
+    }
+    if (n < TLB_FILL_PAGES)
+        pages[n] = vaddr | (1 << mmu_idx);
+    mmu->fill_count[idx] = n + 1;
+}
+
+/* Drop the QEMU TLB pages that were filled through entry idx.  Pages
+   filled with the MMU off are never translated by the UTLB and stay.  */
 static void mmu_flush_idx(CPUMBState *env, unsigned int idx)
 {
     CPUState *cs = CPU(mb_env_get_cpu(env));
     struct microblaze_mmu *mmu = &env->mmu;
-    unsigned int tlb_size;
-    uint32_t tlb_tag, end, t;
+    unsigned int i, n;
 
-    t = mmu->rams[RAM_TAG][idx];
-    if (!(t & TLB_VALID))
+    if (idx >= TLB_ENTRIES)
         return;
 
-    tlb_tag = t & TLB_EPN_MASK;
-    tlb_size = tlb_decode_size((t & TLB_PAGESZ_MASK) >> 7);
-    end = tlb_tag + tlb_size;
-
-    while (tlb_tag < end) {
-        tlb_flush_page(cs, tlb_tag);
-        tlb_tag += TARGET_PAGE_SIZE;
+    n = mmu->fill_count[idx];
+    if (n > TLB_FILL_PAGES) {
+        /* Lost track, too many pages of a large entry were in use.  */
+        tlb_flush_by_mmuidx(cs, MMU_KERNEL_IDX, MMU_USER_IDX, -1);
+    } else {
+        for (i = 0; i < n; i++) {
+            uint32_t p = mmu->fill_pages[idx][i];
+            uint32_t vaddr = p & TARGET_PAGE_MASK;
+
+            switch (p & ~TARGET_PAGE_MASK) {
+                case 1 << MMU_KERNEL_IDX:
+                    tlb_flush_page_by_mmuidx(cs, vaddr, MMU_KERNEL_IDX, -1);
+                    break;
+                case 1 << MMU_USER_IDX:
+                    tlb_flush_page_by_mmuidx(cs, vaddr, MMU_USER_IDX, -1);
+                    break;
+                default:
+                    tlb_flush_page_by_mmuidx(cs, vaddr, MMU_KERNEL_IDX,
+                                             MMU_USER_IDX, -1);
+                    break;
+            }
+        }
     }
+    mmu->fill_count[idx] = 0;
 }
 
 static void mmu_change_pid(CPUMBState *env, unsigned int newpid) 
 {
     struct microblaze_mmu *mmu = &env->mmu;
     unsigned int i;
-    uint32_t t;
 
     if (newpid & ~0xff)
         qemu_log("Illegal rpid=%x\n", newpid);
 
-    for (i = 0; i < ARRAY_SIZE(mmu->rams[RAM_TAG]); i++) {
-        /* Lookup and decode.  */
-        t = mmu->rams[RAM_TAG][i];
-        if (t & TLB_VALID) {
-            if (mmu->tids[i] && ((mmu->regs[MMU_R_PID] & 0xff) == mmu->tids[i]))
-                mmu_flush_idx(env, i);
-        }
+    /* Only the entries of the outgoing PID that actually filled the QEMU
+       TLB have anything to drop.  */
+    for (i = 0; i < TLB_ENTRIES; i++) {
+        if (mmu->fill_count[i] && mmu->tids[i]
+            && ((mmu->regs[MMU_R_PID] & 0xff) == mmu->tids[i]))
+            mmu_flush_idx(env, i);
     }
 }
 
@@ -77,15 +147,27 @@ unsigned int mmu_translate(struct microblaze_mmu *mmu,
                            struct microblaze_mmu_lookup *lu,
                            target_ulong vaddr, int rw, int mmu_idx)
 {
-    unsigned int i, hit = 0;
+    unsigned int i, sz, hit = 0;
     unsigned int tlb_ex = 0, tlb_wr = 0, tlb_zsel;
     unsigned int tlb_size;
     uint32_t tlb_tag, tlb_rpn, mask, t0;
+    uint64_t candidates = 0;
+
+    /* Only the entries that share a bucket with vaddr can match.  Walking
+       them in index order keeps the first-match priority of the scan.  */
+    for (sz = 0; sz < TLB_PAGESZ_CLASSES; sz++) {
+        if (mmu->index_used[sz]) {
+            candidates |= mmu->index[sz][mmu_index_hash(vaddr, sz)];
+        }
+    }
 
     lu->err = ERR_MISS;
-    for (i = 0; i < ARRAY_SIZE(mmu->rams[RAM_TAG]); i++) {
+    while (candidates) {
         uint32_t t, d;
 
+        i = ctz64(candidates);
+        candidates &= candidates - 1;
+
         /* Lookup and decode.  */
         t = mmu->rams[RAM_TAG][i];
         D(qemu_log("TLB %d valid=%d\n", i, t & TLB_VALID));
@@ -239,8 +321,14 @@ void mmu_write(CPUMBState *env, uint32_t rn, uint32_t v)
                              i, env->sregs[SR_PC]);
                 env->mmu.tids[i] = env->mmu.regs[MMU_R_PID] & 0xff;
                 mmu_flush_idx(env, i);
+                if (i < TLB_ENTRIES) {
+                    mmu_index_del(&env->mmu, i);
+                }
             }
             env->mmu.rams[rn & 1][i] = v;
+            if (rn == MMU_R_TLBHI && i < TLB_ENTRIES) {
+                mmu_index_add(&env->mmu, i);
+            }
 
             D(qemu_log("%s ram[%d][%d]=%x\n", __func__, rn & 1, i, v));
             break;
@@ -254,6 +342,7 @@ void mmu_write(CPUMBState *env, uint32_t rn, uint32_t v)
                Fortunately, these are very uncommon.  */
             if (v != env->mmu.regs[rn]) {
                 tlb_flush(CPU(cpu), 1);
+                memset(env->mmu.fill_count, 0, sizeof(env->mmu.fill_count));
             }
             env->mmu.regs[rn] = v;
             break;
@@ -292,6 +381,20 @@ void mmu_write(CPUMBState *env, uint32_t rn, uint32_t v)
    }
 }
 
+/* Recompute the lookup index from the tag ram, after it was loaded from a
+   snapshot.  The caller flushes the QEMU TLB, so no fill is recorded.  */
+void mmu_rebuild(struct microblaze_mmu *mmu)
+{
+    unsigned int i;
+
+    memset(mmu->index, 0, sizeof(mmu->index));
+    memset(mmu->index_used, 0, sizeof(mmu->index_used));
+    memset(mmu->fill_count, 0, sizeof(mmu->fill_count));
+    for (i = 0; i < TLB_ENTRIES; i++) {
+        mmu_index_add(mmu, i);
+    }
+}
+
 void mmu_init(struct microblaze_mmu *mmu)
 {
     int i;
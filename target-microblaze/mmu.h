@@ -55,6 +55,9 @@
 #define TLB_G                 0x00000001 /* Memory is guarded from prefetch */
 
 #define TLB_ENTRIES    64
+#define TLB_PAGESZ_CLASSES    8
+#define TLB_INDEX_BUCKETS     64
+#define TLB_FILL_PAGES        16
 
 struct microblaze_mmu
 {
@@ -62,6 +65,22 @@ struct microblaze_mmu
     uint32_t rams[2][TLB_ENTRIES];
     /* We keep a separate ram for the tids to avoid the 48 bit tag width.  */
     uint8_t tids[TLB_ENTRIES];
+
+    /* Lookup index derived from the tag ram, updated on every TLBHI write.
+       For each page size, a bitmap of the valid entries whose EPN hashes to
+       the bucket.  The TID is not part of the key, it is checked on the
+       candidates like the rest of the entry.  */
+    uint64_t index[TLB_PAGESZ_CLASSES][TLB_INDEX_BUCKETS];
+    /* Number of valid entries per page size.  */
+    uint8_t index_used[TLB_PAGESZ_CLASSES];
+
+    /* QEMU TLB pages filled through each entry, so that rewriting the
+       entry or switching PID only drops those.  Each record is a page
+       address with a bitmask of the mmu_idx it was filled for in the low
+       bits.  A count above TLB_FILL_PAGES means the records overflowed.  */
+    uint32_t fill_pages[TLB_ENTRIES][TLB_FILL_PAGES];
+    uint8_t fill_count[TLB_ENTRIES];
+
     /* Control flops.  */
     uint32_t regs[8];
 
@@ -88,3 +107,6 @@ unsigned int mmu_translate(struct microblaze_mmu *mmu,
 uint32_t mmu_read(CPUMBState *env, uint32_t rn);
 void mmu_write(CPUMBState *env, uint32_t rn, uint32_t v);
 void mmu_init(struct microblaze_mmu *mmu);
+void mmu_rebuild(struct microblaze_mmu *mmu);
+void mmu_note_fill(struct microblaze_mmu *mmu, unsigned int idx,
+                   uint32_t vaddr, int mmu_idx);
@@ -96,7 +96,7 @@ void helper_debug(CPUMBState *env)
 
     qemu_log("PC=%8.8x\n", env->sregs[SR_PC]);
     qemu_log("rmsr=%x resr=%x rear=%x debug[%x] imm=%x iflags=%x\n",
-             env->sregs[SR_MSR], env->sregs[SR_ESR], env->sregs[SR_EAR],
+             mb_cpu_read_msr(env), env->sregs[SR_ESR], env->sregs[SR_EAR],
              env->debug, env->imm, env->iflags);
     qemu_log("btaken=%d btarget=%x mode=%s(saved=%s) eip=%d ie=%d\n",
              env->btaken, env->btarget,
@@ -112,17 +112,6 @@ void helper_debug(CPUMBState *env)
     qemu_log("\n\n");
 }
 
-static inline uint32_t compute_carry(uint32_t a, uint32_t b, uint32_t cin)
-{
-    uint32_t cout = 0;
-
-    if ((b == ~0) && cin)
-        cout = 1;
-    else if ((~0 - a) < (b + cin))
-        cout = 1;
-    return cout;
-}
-
 uint32_t helper_cmp(uint32_t a, uint32_t b)
 {
     uint32_t t;
@@ -148,11 +137,6 @@ uint32_t helper_clz(uint32_t t0)
     return clz32(t0);
 }
 
-uint32_t helper_carry(uint32_t a, uint32_t b, uint32_t cf)
-{
-    return compute_carry(a, b, cf);
-}
-
 static inline int div_prepare(CPUMBState *env, uint32_t a, uint32_t b)
 {
     if (b == 0) {
@@ -485,6 +469,33 @@ void helper_mmu_write(CPUMBState *env, uint32_t rn, uint32_t v)
     mmu_write(env, rn, v);
 }
 
+void mb_cpu_do_unaligned_access(CPUState *cs, vaddr addr, int is_write,
+                                int mmu_idx, uintptr_t retaddr)
+{
+    MicroBlazeCPU *cpu = MICROBLAZE_CPU(cs);
+    CPUMBState *env = &cpu->env;
+    uint32_t insn;
+
+    /* MMU faults take priority over unaligned accesses.  */
+    tlb_fill(cs, addr, is_write, mmu_idx, retaddr);
+
+    if (retaddr) {
+        cpu_restore_state(cs, retaddr);
+    }
+    /* Only loads and stores with MSR[EE] set get here, see dec_ldst_align.
+       Recover the destination register and size from the insn.  */
+    insn = cpu_ldl_code(env, env->sregs[SR_PC]);
+    qemu_log_mask(CPU_LOG_INT, "unaligned access addr=%" VADDR_PRIx
+                  " wr=%d insn=%x\n", addr, is_write, insn);
+    env->sregs[SR_EAR] = addr;
+    env->sregs[SR_ESR] = ESR_EC_UNALIGNED_DATA | (is_write << 10)
+                         | ((insn >> 21) & 31) << 5;
+    if ((insn >> 26 & 3) == 2) {
+        env->sregs[SR_ESR] |= 1 << 11;
+    }
+    helper_raise_exception(env, EXCP_HW_EXCP);
+}
+
 void mb_cpu_unassigned_access(CPUState *cs, hwaddr addr,
                               bool is_write, bool is_exec, int is_asi,
                               unsigned size)
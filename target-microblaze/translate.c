@@ -50,6 +50,7 @@ static TCGv cpu_SR[18];
 static TCGv env_imm;
 static TCGv env_btaken;
 static TCGv env_btarget;
+static TCGv env_carry;
 static TCGv env_iflags;
 static TCGv env_res_addr;
 static TCGv env_res_val;
@@ -80,6 +81,9 @@ typedef struct DisasContext {
 #define JMP_INDIRECT  3
     unsigned int jmp;
     uint32_t jmp_pc;
+    /* Chaining slots already taken, a superblock hands slot 0 to its
+       side exit.  */
+    unsigned int goto_tb_used;
 
     int abort_at_next_insn;
     int nr_nops;
@@ -126,7 +130,13 @@ static void gen_goto_tb(DisasContext *dc, int n, target_ulong dest)
 {
     TranslationBlock *tb;
     tb = dc->tb;
-    if ((tb->pc & TARGET_PAGE_MASK) == (dest & TARGET_PAGE_MASK)) {
+    /* Fall back to the other slot, then to an unchained exit.  */
+    if (dc->goto_tb_used & (1 << n)) {
+        n ^= 1;
+    }
+    if (!(dc->goto_tb_used & (1 << n))
+        && (tb->pc & TARGET_PAGE_MASK) == (dest & TARGET_PAGE_MASK)) {
+        dc->goto_tb_used |= 1 << n;
         tcg_gen_goto_tb(n);
         tcg_gen_movi_tl(cpu_SR[SR_PC], dest);
         tcg_gen_exit_tb((uintptr_t)tb + n);
@@ -136,33 +146,40 @@ static void gen_goto_tb(DisasContext *dc, int n, target_ulong dest)
     }
 }
 
+/*
+ * The carry lives in env->msr_c as 0 or 1, outside of MSR.  Only MSR
+ * reads and writes (msr_read/msr_write, mb_cpu_read_msr/mb_cpu_write_msr)
+ * need to merge it with MSR[C] and MSR[CC].
+ */
 static void read_carry(DisasContext *dc, TCGv d)
 {
-    tcg_gen_shri_tl(d, cpu_SR[SR_MSR], 31);
+    tcg_gen_mov_tl(d, env_carry);
 }
 
 /*
- * write_carry sets the carry bits in MSR based on bit 0 of v.
+ * write_carry sets the carry based on bit 0 of v.
  * v[31:1] are ignored.
  */
 static void write_carry(DisasContext *dc, TCGv v)
 {
-    TCGv t0 = tcg_temp_new();
-    tcg_gen_shli_tl(t0, v, 31);
-    tcg_gen_sari_tl(t0, t0, 31);
-    tcg_gen_andi_tl(t0, t0, (MSR_C | MSR_CC));
-    tcg_gen_andi_tl(cpu_SR[SR_MSR], cpu_SR[SR_MSR],
-                    ~(MSR_C | MSR_CC));
-    tcg_gen_or_tl(cpu_SR[SR_MSR], cpu_SR[SR_MSR], t0);
-    tcg_temp_free(t0);
+    tcg_gen_andi_tl(env_carry, v, 1);
 }
 
 static void write_carryi(DisasContext *dc, bool carry)
 {
-    TCGv t0 = tcg_temp_new();
-    tcg_gen_movi_tl(t0, carry);
-    write_carry(dc, t0);
-    tcg_temp_free(t0);
+    tcg_gen_movi_tl(env_carry, carry);
+}
+
+/* d = a + b + cf, with the carry out going straight to env_carry.  */
+static void gen_add_carry(TCGv d, TCGv a, TCGv b, TCGv cf)
+{
+    TCGv zero = tcg_const_tl(0);
+
+    tcg_gen_add2_tl(d, env_carry, a, zero, b, zero);
+    if (!TCGV_IS_UNUSED(cf)) {
+        tcg_gen_add2_tl(d, env_carry, d, env_carry, cf, zero);
+    }
+    tcg_temp_free(zero);
 }
 
 /* True if ALU operand b is a small immediate that may deserve
@@ -218,25 +235,22 @@ static void dec_add(DisasContext *dc)
 
     /* From now on, we can assume k is zero.  So we need to update MSR.  */
     /* Extract carry.  */
-    cf = tcg_temp_new();
+    TCGV_UNUSED(cf);
     if (c) {
+        cf = tcg_temp_new();
         read_carry(dc, cf);
-    } else {
-        tcg_gen_movi_tl(cf, 0);
     }
 
     if (dc->rd) {
-        TCGv ncf = tcg_temp_new();
-        gen_helper_carry(ncf, cpu_R[dc->ra], *(dec_alu_op_b(dc)), cf);
-        tcg_gen_add_tl(cpu_R[dc->rd], cpu_R[dc->ra], *(dec_alu_op_b(dc)));
-        tcg_gen_add_tl(cpu_R[dc->rd], cpu_R[dc->rd], cf);
-        write_carry(dc, ncf);
-        tcg_temp_free(ncf);
+        gen_add_carry(cpu_R[dc->rd], cpu_R[dc->ra], *(dec_alu_op_b(dc)), cf);
     } else {
-        gen_helper_carry(cf, cpu_R[dc->ra], *(dec_alu_op_b(dc)), cf);
-        write_carry(dc, cf);
+        TCGv d = tcg_temp_new();
+        gen_add_carry(d, cpu_R[dc->ra], *(dec_alu_op_b(dc)), cf);
+        tcg_temp_free(d);
+    }
+    if (c) {
+        tcg_temp_free(cf);
     }
-    tcg_temp_free(cf);
 }
 
 static void dec_sub(DisasContext *dc)
@@ -296,15 +310,11 @@ static void dec_sub(DisasContext *dc)
     tcg_gen_not_tl(na, cpu_R[dc->ra]);
 
     if (dc->rd) {
-        TCGv ncf = tcg_temp_new();
-        gen_helper_carry(ncf, na, *(dec_alu_op_b(dc)), cf);
-        tcg_gen_add_tl(cpu_R[dc->rd], na, *(dec_alu_op_b(dc)));
-        tcg_gen_add_tl(cpu_R[dc->rd], cpu_R[dc->rd], cf);
-        write_carry(dc, ncf);
-        tcg_temp_free(ncf);
+        gen_add_carry(cpu_R[dc->rd], na, *(dec_alu_op_b(dc)), cf);
     } else {
-        gen_helper_carry(cf, na, *(dec_alu_op_b(dc)), cf);
-        write_carry(dc, cf);
+        TCGv d = tcg_temp_new();
+        gen_add_carry(d, na, *(dec_alu_op_b(dc)), cf);
+        tcg_temp_free(d);
     }
     tcg_temp_free(cf);
     tcg_temp_free(na);
@@ -397,7 +407,14 @@ static void dec_xor(DisasContext *dc)
 
 static inline void msr_read(DisasContext *dc, TCGv d)
 {
-    tcg_gen_mov_tl(d, cpu_SR[SR_MSR]);
+    TCGv t;
+
+    /* Replicate the carry into MSR[C] and MSR[CC].  */
+    t = tcg_temp_new();
+    tcg_gen_muli_tl(t, env_carry, MSR_C | MSR_CC);
+    tcg_gen_andi_tl(d, cpu_SR[SR_MSR], ~(MSR_C | MSR_CC));
+    tcg_gen_or_tl(d, d, t);
+    tcg_temp_free(t);
 }
 
 static inline void msr_write(DisasContext *dc, TCGv v)
@@ -406,6 +423,9 @@ static inline void msr_write(DisasContext *dc, TCGv v)
 
     t = tcg_temp_new();
     dc->cpustate_changed = 1;
+    /* MSR[CC] is a read-only copy of MSR[C].  */
+    tcg_gen_shri_tl(t, v, 2);
+    write_carry(dc, t);
     /* PVR bit is not writable.  */
     tcg_gen_andi_tl(t, v, ~MSR_PVR);
     tcg_gen_andi_tl(cpu_SR[SR_MSR], cpu_SR[SR_MSR], MSR_PVR);
@@ -739,7 +759,7 @@ static void dec_bit(DisasContext *dc)
             t0 = tcg_temp_new();
 
             LOG_DIS("src r%d r%d\n", dc->rd, dc->ra);
-            tcg_gen_andi_tl(t0, cpu_SR[SR_MSR], MSR_CC);
+            tcg_gen_shli_tl(t0, env_carry, 31);
             write_carry(dc, cpu_R[dc->ra]);
             if (dc->rd) {
                 tcg_gen_shri_tl(cpu_R[dc->rd], cpu_R[dc->ra], 1);
@@ -891,11 +911,33 @@ static inline TCGv *compute_ldst_addr(DisasContext *dc, TCGv *t)
     return t;
 }
 
+/*
+ * Whether an access of @size bytes needs its alignment checked.  With
+ * exceptions enabled the softmmu fast path does the check inline, through
+ * MO_ALIGN, and mb_cpu_do_unaligned_access() raises the exception.
+ * Otherwise gen_helper_memalign runs after the access.
+ */
+static bool dec_ldst_align(DisasContext *dc, unsigned int size,
+                           TCGMemOp *mop)
+{
+    if (size == 1 || !(dc->cpu->env.pvr.regs[2] & PVR2_UNALIGNED_EXC_MASK)) {
+        return false;
+    }
+#ifndef CONFIG_USER_ONLY
+    if (dc->tb_flags & MSR_EE_FLAG) {
+        *mop |= MO_ALIGN;
+        return false;
+    }
+#endif
+    return true;
+}
+
 static void dec_load(DisasContext *dc)
 {
     TCGv t, v, *addr;
     unsigned int size, rev = 0, ex = 0;
     TCGMemOp mop;
+    bool align;
 
     mop = dc->opcode & 3;
     size = 1 << mop;
@@ -994,9 +1036,10 @@ static void dec_load(DisasContext *dc)
      * address and if that succeeds we write into the destination reg.
      */
     v = tcg_temp_new();
+    align = dec_ldst_align(dc, size, &mop);
     tcg_gen_qemu_ld_tl(v, *addr, cpu_mmu_index(&dc->cpu->env, false), mop);
 
-    if ((dc->cpu->env.pvr.regs[2] & PVR2_UNALIGNED_EXC_MASK) && size > 1) {
+    if (align) {
         tcg_gen_movi_tl(cpu_SR[SR_PC], dc->pc);
         gen_helper_memalign(cpu_env, *addr, tcg_const_tl(dc->rd),
                             tcg_const_tl(0), tcg_const_tl(size - 1));
@@ -1026,6 +1069,7 @@ static void dec_store(DisasContext *dc)
     TCGLabel *swx_skip = NULL;
     unsigned int size, rev = 0, ex = 0;
     TCGMemOp mop;
+    bool align;
 
     mop = dc->opcode & 3;
     size = 1 << mop;
@@ -1123,10 +1167,11 @@ static void dec_store(DisasContext *dc)
                 break;
         }
     }
+    align = dec_ldst_align(dc, size, &mop);
     tcg_gen_qemu_st_tl(cpu_R[dc->rd], *addr, cpu_mmu_index(&dc->cpu->env, false), mop);
 
     /* Verify alignment if needed.  */
-    if ((dc->cpu->env.pvr.regs[2] & PVR2_UNALIGNED_EXC_MASK) && size > 1) {
+    if (align) {
         tcg_gen_movi_tl(cpu_SR[SR_PC], dc->pc);
         /* FIXME: if the alignment is wrong, we should restore the value
          *        in memory. One possible way to achieve this is to probe
@@ -1300,8 +1345,9 @@ static inline void do_rti(DisasContext *dc)
     TCGv t0, t1;
     t0 = tcg_temp_new();
     t1 = tcg_temp_new();
-    tcg_gen_shri_tl(t0, cpu_SR[SR_MSR], 1);
-    tcg_gen_ori_tl(t1, cpu_SR[SR_MSR], MSR_IE);
+    msr_read(dc, t1);
+    tcg_gen_shri_tl(t0, t1, 1);
+    tcg_gen_ori_tl(t1, t1, MSR_IE);
     tcg_gen_andi_tl(t0, t0, (MSR_VM | MSR_UM));
 
     tcg_gen_andi_tl(t1, t1, ~(MSR_VM | MSR_UM));
@@ -1317,7 +1363,8 @@ static inline void do_rtb(DisasContext *dc)
     TCGv t0, t1;
     t0 = tcg_temp_new();
     t1 = tcg_temp_new();
-    tcg_gen_andi_tl(t1, cpu_SR[SR_MSR], ~MSR_BIP);
+    msr_read(dc, t1);
+    tcg_gen_andi_tl(t1, t1, ~MSR_BIP);
     tcg_gen_shri_tl(t0, t1, 1);
     tcg_gen_andi_tl(t0, t0, (MSR_VM | MSR_UM));
 
@@ -1335,7 +1382,8 @@ static inline void do_rte(DisasContext *dc)
     t0 = tcg_temp_new();
     t1 = tcg_temp_new();
 
-    tcg_gen_ori_tl(t1, cpu_SR[SR_MSR], MSR_EE);
+    msr_read(dc, t1);
+    tcg_gen_ori_tl(t1, t1, MSR_EE);
     tcg_gen_andi_tl(t1, t1, ~MSR_EIP);
     tcg_gen_shri_tl(t0, t1, 1);
     tcg_gen_andi_tl(t0, t0, (MSR_VM | MSR_UM));
@@ -1626,6 +1674,22 @@ static inline void decode(DisasContext *dc, uint32_t ir)
     }
 }
 
+/* Whether translation can carry on at the target of the direct branch
+   whose delay slot just completed, instead of ending the TB.  Only
+   forward branches within the page are followed: the TB then still
+   covers [pc, pc + size) for invalidation and cannot loop.  With icount
+   the TB is charged for all its insns up front, which the side exit of
+   a conditional branch would overcharge, so only jumps are followed.  */
+static bool mb_follow_branch(DisasContext *dc, uint32_t next_page_start)
+{
+    if (dc->jmp == JMP_DIRECT_CC && (dc->tb->cflags & CF_USE_ICOUNT)) {
+        return false;
+    }
+    return dc->cpu->cfg.superblocks
+           && !dc->singlestep_enabled && !singlestep
+           && dc->jmp_pc >= dc->pc && dc->jmp_pc < next_page_start;
+}
+
 /* generate intermediate code for basic block 'tb'.  */
 void gen_intermediate_code(CPUMBState *env, struct TranslationBlock *tb)
 {
@@ -1646,6 +1710,7 @@ void gen_intermediate_code(CPUMBState *env, struct TranslationBlock *tb)
 
     dc->is_jmp = DISAS_NEXT;
     dc->jmp = 0;
+    dc->goto_tb_used = 0;
     dc->delayed_branch = !!(dc->tb_flags & D_FLAG);
     if (dc->delayed_branch) {
         dc->jmp = JMP_INDIRECT;
@@ -1724,6 +1789,25 @@ void gen_intermediate_code(CPUMBState *env, struct TranslationBlock *tb)
                 if (dc->jmp == JMP_INDIRECT) {
                     eval_cond_jmp(dc, env_btarget, tcg_const_tl(dc->pc));
                     dc->is_jmp = DISAS_JUMP;
+                } else if (dc->jmp == JMP_DIRECT
+                           && mb_follow_branch(dc, next_page_start)) {
+                    /* Carry on at the target, out of the delay slot.  */
+                    t_sync_flags(dc);
+                    dc->jmp = JMP_NOJMP;
+                    dc->pc = dc->jmp_pc;
+                    continue;
+                } else if (dc->jmp == JMP_DIRECT_CC
+                           && !(dc->goto_tb_used & 1)
+                           && mb_follow_branch(dc, next_page_start)) {
+                    TCGLabel *l1 = gen_new_label();
+                    t_sync_flags(dc);
+                    /* Forward branches are predicted not taken, leave
+                       through a side exit on the taken path only.  */
+                    tcg_gen_brcondi_tl(TCG_COND_EQ, env_btaken, 0, l1);
+                    gen_goto_tb(dc, 0, dc->jmp_pc);
+                    gen_set_label(l1);
+                    dc->jmp = JMP_NOJMP;
+                    continue;
                 } else if (dc->jmp == JMP_DIRECT) {
                     t_sync_flags(dc);
                     gen_goto_tb(dc, 0, dc->jmp_pc);
@@ -1829,7 +1913,7 @@ void mb_cpu_dump_state(CPUState *cs, FILE *f, fprintf_function cpu_fprintf,
     cpu_fprintf(f, "IN: PC=%x %s\n",
                 env->sregs[SR_PC], lookup_symbol(env->sregs[SR_PC]));
     cpu_fprintf(f, "rmsr=%x resr=%x rear=%x debug=%x imm=%x iflags=%x fsr=%x\n",
-             env->sregs[SR_MSR], env->sregs[SR_ESR], env->sregs[SR_EAR],
+             mb_cpu_read_msr(env), env->sregs[SR_ESR], env->sregs[SR_EAR],
              env->debug, env->imm, env->iflags, env->sregs[SR_FSR]);
     cpu_fprintf(f, "btaken=%d btarget=%x mode=%s(saved=%s) eip=%d ie=%d\n",
              env->btaken, env->btarget,
@@ -1878,6 +1962,9 @@ void mb_tcg_init(void)
     env_btaken = tcg_global_mem_new(TCG_AREG0,
                      offsetof(CPUMBState, btaken),
                      "btaken");
+    env_carry = tcg_global_mem_new(TCG_AREG0,
+                     offsetof(CPUMBState, msr_c),
+                     "carry");
     env_res_addr = tcg_global_mem_new(TCG_AREG0,
                      offsetof(CPUMBState, res_addr),
                      "res_addr");
@@ -0,0 +1,283 @@
+/*
+ * Generic vector operation expansion
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "tcg.h"
+#include "tcg-op.h"
+#include "tcg-op-gvec.h"
+
+typedef void GVecGen3Fn(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b);
+typedef void GVecGen2iFn(unsigned vece, TCGv_i64 d, TCGv_i64 a,
+                         unsigned shift);
+
+/* Replicate the low 8 << vece bits of c across 64 bits */
+static uint64_t dup_const(unsigned vece, uint64_t c)
+{
+    switch (vece) {
+    case MO_8:
+        return 0x0101010101010101ull * (uint8_t)c;
+    case MO_16:
+        return 0x0001000100010001ull * (uint16_t)c;
+    case MO_32:
+        return 0x0000000100000001ull * (uint32_t)c;
+    default:
+        return c;
+    }
+}
+
+/* The top bit of every lane */
+static uint64_t lane_msb(unsigned vece)
+{
+    return dup_const(vece, 1ull << ((8 << vece) - 1));
+}
+
+static void expand_3(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                     uint32_t aofs, uint32_t bofs, uint32_t oprsz,
+                     GVecGen3Fn *fn)
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    TCGv_i64 t2 = tcg_temp_new_i64();
+    uint32_t i;
+
+    tcg_debug_assert(oprsz % 8 == 0);
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(t0, base, aofs + i);
+        tcg_gen_ld_i64(t1, base, bofs + i);
+        fn(vece, t2, t0, t1);
+        tcg_gen_st_i64(t2, base, dofs + i);
+    }
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t0);
+}
+
+static void expand_2i(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                      uint32_t aofs, unsigned shift, uint32_t oprsz,
+                      GVecGen2iFn *fn)
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    uint32_t i;
+
+    tcg_debug_assert(oprsz % 8 == 0);
+    tcg_debug_assert(shift < (8u << vece));
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(t0, base, aofs + i);
+        fn(vece, t1, t0, shift);
+        tcg_gen_st_i64(t1, base, dofs + i);
+    }
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t0);
+}
+
+/*
+ * Add with the top bit of each lane cleared so that no carry crosses into
+ * the next lane, then compute the top bits separately as a ^ b ^ carry-in.
+ */
+static void gen_add(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 t1, t2, t3;
+
+    if (vece == MO_64) {
+        tcg_gen_add_i64(d, a, b);
+        return;
+    }
+
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    t3 = tcg_temp_new_i64();
+    tcg_gen_andi_i64(t1, a, ~lane_msb(vece));
+    tcg_gen_andi_i64(t2, b, ~lane_msb(vece));
+    tcg_gen_xor_i64(t3, a, b);
+    tcg_gen_add_i64(d, t1, t2);
+    tcg_gen_andi_i64(t3, t3, lane_msb(vece));
+    tcg_gen_xor_i64(d, d, t3);
+    tcg_temp_free_i64(t3);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t1);
+}
+
+/* Likewise, with the top bit of each lane of a set to absorb borrows */
+static void gen_sub(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 t1, t2, t3;
+
+    if (vece == MO_64) {
+        tcg_gen_sub_i64(d, a, b);
+        return;
+    }
+
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    t3 = tcg_temp_new_i64();
+    tcg_gen_ori_i64(t1, a, lane_msb(vece));
+    tcg_gen_andi_i64(t2, b, ~lane_msb(vece));
+    tcg_gen_eqv_i64(t3, a, b);
+    tcg_gen_sub_i64(d, t1, t2);
+    tcg_gen_andi_i64(t3, t3, lane_msb(vece));
+    tcg_gen_xor_i64(d, d, t3);
+    tcg_temp_free_i64(t3);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t1);
+}
+
+/*
+ * x = a ^ b is zero in the lanes that are equal.  Adding the low bits of
+ * each lane of x to all ones sets the top bit of the lanes whose low bits
+ * are nonzero, without carrying out of the lane; or-ing x in takes care of
+ * the top bit itself.  The top bit of an equal lane is then spread to the
+ * whole lane.
+ */
+static void gen_cmpeq(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 t1, t2, m;
+
+    if (vece == MO_64) {
+        tcg_gen_setcond_i64(TCG_COND_EQ, d, a, b);
+        tcg_gen_neg_i64(d, d);
+        return;
+    }
+
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    m = tcg_const_i64(lane_msb(vece));
+    tcg_gen_xor_i64(t1, a, b);
+    tcg_gen_andc_i64(t2, t1, m);
+    tcg_gen_addi_i64(t2, t2, ~lane_msb(vece));
+    tcg_gen_or_i64(t2, t2, t1);
+    /* top bit set in the lanes that are equal, everything else clear */
+    tcg_gen_andc_i64(t2, m, t2);
+    tcg_gen_shri_i64(t1, t2, (8 << vece) - 1);
+    tcg_gen_sub_i64(d, t2, t1);
+    tcg_gen_or_i64(d, d, t2);
+    tcg_temp_free_i64(m);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t1);
+}
+
+static void gen_and(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_and_i64(d, a, b);
+}
+
+static void gen_or(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_or_i64(d, a, b);
+}
+
+static void gen_xor(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_xor_i64(d, a, b);
+}
+
+static void gen_andc(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_andc_i64(d, a, b);
+}
+
+/* Shift the whole word, then clear the bits that crossed a lane boundary */
+static void gen_shli(unsigned vece, TCGv_i64 d, TCGv_i64 a, unsigned shift)
+{
+    tcg_gen_shli_i64(d, a, shift);
+    if (vece != MO_64) {
+        tcg_gen_andi_i64(d, d, dup_const(vece, -1ull << shift));
+    }
+}
+
+static void gen_shri(unsigned vece, TCGv_i64 d, TCGv_i64 a, unsigned shift)
+{
+    tcg_gen_shri_i64(d, a, shift);
+    if (vece != MO_64) {
+        tcg_gen_andi_i64(d, d, dup_const(vece, -1ull >> (64 - (8 << vece) +
+                                                         shift)));
+    }
+}
+
+/*
+ * A logical shift, then the sign bit of each lane, which is now @shift bits
+ * lower, is replicated into the @shift bits above it by a multiplication.
+ */
+static void gen_sari(unsigned vece, TCGv_i64 d, TCGv_i64 a, unsigned shift)
+{
+    TCGv_i64 t;
+
+    if (vece == MO_64) {
+        tcg_gen_sari_i64(d, a, shift);
+        return;
+    }
+    if (shift == 0) {
+        tcg_gen_mov_i64(d, a);
+        return;
+    }
+
+    t = tcg_temp_new_i64();
+    gen_shri(vece, d, a, shift);
+    tcg_gen_andi_i64(t, d, lane_msb(vece) >> shift);
+    tcg_gen_muli_i64(t, t, (2ull << shift) - 2);
+    tcg_gen_or_i64(d, d, t);
+    tcg_temp_free_i64(t);
+}
+
+void tcg_gen_gvec_add(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                      uint32_t aofs, uint32_t bofs, uint32_t oprsz)
+{
+    expand_3(vece, base, dofs, aofs, bofs, oprsz, gen_add);
+}
+
+void tcg_gen_gvec_sub(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                      uint32_t aofs, uint32_t bofs, uint32_t oprsz)
+{
+    expand_3(vece, base, dofs, aofs, bofs, oprsz, gen_sub);
+}
+
+void tcg_gen_gvec_cmpeq(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                        uint32_t aofs, uint32_t bofs, uint32_t oprsz)
+{
+    expand_3(vece, base, dofs, aofs, bofs, oprsz, gen_cmpeq);
+}
+
+void tcg_gen_gvec_and(TCGv_ptr base, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz)
+{
+    expand_3(MO_64, base, dofs, aofs, bofs, oprsz, gen_and);
+}
+
+void tcg_gen_gvec_or(TCGv_ptr base, uint32_t dofs, uint32_t aofs,
+                     uint32_t bofs, uint32_t oprsz)
+{
+    expand_3(MO_64, base, dofs, aofs, bofs, oprsz, gen_or);
+}
+
+void tcg_gen_gvec_xor(TCGv_ptr base, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz)
+{
+    expand_3(MO_64, base, dofs, aofs, bofs, oprsz, gen_xor);
+}
+
+void tcg_gen_gvec_andc(TCGv_ptr base, uint32_t dofs, uint32_t aofs,
+                       uint32_t bofs, uint32_t oprsz)
+{
+    expand_3(MO_64, base, dofs, aofs, bofs, oprsz, gen_andc);
+}
+
+void tcg_gen_gvec_shli(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                       uint32_t aofs, unsigned shift, uint32_t oprsz)
+{
+    expand_2i(vece, base, dofs, aofs, shift, oprsz, gen_shli);
+}
+
+void tcg_gen_gvec_shri(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                       uint32_t aofs, unsigned shift, uint32_t oprsz)
+{
+    expand_2i(vece, base, dofs, aofs, shift, oprsz, gen_shri);
+}
+
+void tcg_gen_gvec_sari(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                       uint32_t aofs, unsigned shift, uint32_t oprsz)
+{
+    expand_2i(vece, base, dofs, aofs, shift, oprsz, gen_sari);
+}
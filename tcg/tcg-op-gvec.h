@@ -0,0 +1,52 @@
+/*
+ * Generic vector operation expansion
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef TCG_TCG_OP_GVEC_H
+#define TCG_TCG_OP_GVEC_H 1
+
+/*
+ * "Generic vector" operations work on vectors of @oprsz bytes stored at
+ * offsets from @base, usually the cpu_env of the translator.  @oprsz must be
+ * a multiple of 8.  Each vector is made of lanes of 8 << @vece bits (@vece is
+ * MO_8 ... MO_64) and the operation is applied to every lane independently.
+ * The destination may be the same as either source, but must not partially
+ * overlap them.
+ *
+ * This is a scalar-only fallback: every operation is expanded into 64-bit
+ * integer TCG ops on each 8-byte piece, with lane carries and shifts
+ * masked off where needed.  There are no vector TCG types and no backend
+ * emits host SIMD instructions for these.
+ */
+
+void tcg_gen_gvec_add(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                      uint32_t aofs, uint32_t bofs, uint32_t oprsz);
+void tcg_gen_gvec_sub(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                      uint32_t aofs, uint32_t bofs, uint32_t oprsz);
+/* Lanes are all ones if equal, all zeros otherwise */
+void tcg_gen_gvec_cmpeq(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                        uint32_t aofs, uint32_t bofs, uint32_t oprsz);
+
+/* The logical operations do not depend on the lane size */
+void tcg_gen_gvec_and(TCGv_ptr base, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz);
+void tcg_gen_gvec_or(TCGv_ptr base, uint32_t dofs, uint32_t aofs,
+                     uint32_t bofs, uint32_t oprsz);
+void tcg_gen_gvec_xor(TCGv_ptr base, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz);
+/* a & ~b */
+void tcg_gen_gvec_andc(TCGv_ptr base, uint32_t dofs, uint32_t aofs,
+                       uint32_t bofs, uint32_t oprsz);
+
+/* Shifts by an immediate, which must be less than the lane size */
+void tcg_gen_gvec_shli(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                       uint32_t aofs, unsigned shift, uint32_t oprsz);
+void tcg_gen_gvec_shri(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                       uint32_t aofs, unsigned shift, uint32_t oprsz);
+void tcg_gen_gvec_sari(unsigned vece, TCGv_ptr base, uint32_t dofs,
+                       uint32_t aofs, unsigned shift, uint32_t oprsz);
+
+#endif
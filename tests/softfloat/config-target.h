@@ -0,0 +1,3 @@
+/* test-softfloat builds softfloat for no target in particular, so that it
+ * uses the default NaN and tininess conventions of softfloat-specialize.h.
+ */
@@ -0,0 +1,361 @@
+/*
+ * QHT unit tests.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+#include <glib.h>
+#include "qemu-common.h"
+#include "qemu/atomic.h"
+#include "qemu/rcu.h"
+#include "qemu/qht.h"
+
+#define N_OBJS 1024
+
+typedef struct TestObj {
+    uint32_t key;
+} TestObj;
+
+static TestObj objs[N_OBJS];
+
+static bool test_cmp(const void *obj, const void *userp)
+{
+    return ((const TestObj *) obj)->key == *(const uint32_t *) userp;
+}
+
+static uint32_t test_hash(uint32_t key)
+{
+    return key * 2654435761u;
+}
+
+/* Only 16 different hashes, so that every chain overflows */
+static uint32_t bad_hash(uint32_t key)
+{
+    return key & 0xf;
+}
+
+static TestObj *lookup(QHT *ht, uint32_t key, uint32_t (*hash)(uint32_t))
+{
+    TestObj *ret;
+
+    rcu_read_lock();
+    ret = qht_lookup(ht, test_cmp, &key, hash(key));
+    rcu_read_unlock();
+    return ret;
+}
+
+static void init_objs(void)
+{
+    int i;
+
+    for (i = 0; i < N_OBJS; i++) {
+        objs[i].key = i;
+    }
+}
+
+static void count_func(QHT *ht, void *obj, uint32_t hash, void *userp)
+{
+    (*(int *) userp)++;
+}
+
+static void test_basic(void)
+{
+    QHT ht;
+    int i, n = 0;
+
+    init_objs();
+    qht_init(&ht, 16, 0);
+    g_assert(lookup(&ht, 1, test_hash) == NULL);
+
+    for (i = 0; i < 100; i++) {
+        g_assert(qht_insert(&ht, &objs[i], test_hash(i)));
+    }
+    g_assert(!qht_insert(&ht, &objs[10], test_hash(10)));
+    for (i = 0; i < 100; i++) {
+        g_assert(lookup(&ht, i, test_hash) == &objs[i]);
+    }
+    g_assert(lookup(&ht, 100, test_hash) == NULL);
+
+    qht_iter(&ht, count_func, &n);
+    g_assert_cmpint(n, ==, 100);
+
+    g_assert(qht_remove(&ht, &objs[10], test_hash(10)));
+    g_assert(!qht_remove(&ht, &objs[10], test_hash(10)));
+    g_assert(lookup(&ht, 10, test_hash) == NULL);
+    g_assert(lookup(&ht, 11, test_hash) == &objs[11]);
+
+    qht_reset(&ht);
+    for (i = 0; i < 100; i++) {
+        g_assert(lookup(&ht, i, test_hash) == NULL);
+    }
+    g_assert(qht_insert(&ht, &objs[10], test_hash(10)));
+    g_assert(lookup(&ht, 10, test_hash) == &objs[10]);
+
+    qht_destroy(&ht);
+}
+
+/* Removal from the middle of long chains keeps every other entry reachable */
+static void test_chains(void)
+{
+    QHT ht;
+    QHTStats stats;
+    int i;
+
+    init_objs();
+    qht_init(&ht, 64, 0);
+    for (i = 0; i < N_OBJS; i++) {
+        g_assert(qht_insert(&ht, &objs[i], bad_hash(i)));
+    }
+    qht_statistics(&ht, &stats);
+    g_assert_cmpint(stats.entries, ==, N_OBJS);
+    g_assert_cmpint(stats.used_head_buckets, ==, 16);
+    g_assert_cmpint(stats.max_chain, >, 1);
+
+    for (i = 0; i < N_OBJS; i += 3) {
+        g_assert(qht_remove(&ht, &objs[i], bad_hash(i)));
+    }
+    for (i = 0; i < N_OBJS; i++) {
+        g_assert(lookup(&ht, i, bad_hash) == (i % 3 ? &objs[i] : NULL));
+    }
+    for (i = 0; i < N_OBJS; i += 3) {
+        g_assert(qht_insert(&ht, &objs[i], bad_hash(i)));
+    }
+    for (i = 0; i < N_OBJS; i++) {
+        g_assert(lookup(&ht, i, bad_hash) == &objs[i]);
+    }
+
+    qht_destroy(&ht);
+}
+
+static void test_resize(void)
+{
+    QHT ht;
+    QHTStats stats;
+    size_t head_buckets;
+    int i;
+
+    init_objs();
+    qht_init(&ht, 4, QHT_MODE_AUTO_RESIZE);
+    qht_statistics(&ht, &stats);
+    head_buckets = stats.head_buckets;
+
+    for (i = 0; i < N_OBJS; i++) {
+        g_assert(qht_insert(&ht, &objs[i], test_hash(i)));
+    }
+    qht_statistics(&ht, &stats);
+    g_assert_cmpint(stats.head_buckets, >, head_buckets);
+    g_assert_cmpint(stats.entries, ==, N_OBJS);
+    for (i = 0; i < N_OBJS; i++) {
+        g_assert(lookup(&ht, i, test_hash) == &objs[i]);
+    }
+
+    /* Old maps are freed by the RCU thread */
+    synchronize_rcu();
+    qht_destroy(&ht);
+}
+
+/*
+ * Readers look up the first half of the objects, which are always in the
+ * table, while a writer keeps adding and removing the second half and the
+ * table resizes under them.
+ */
+#define STRESS_READERS 4
+#define STRESS_ROUNDS  200
+
+static QHT stress_ht;
+static int stress_stop;
+static long stress_misses;
+
+static void *stress_reader(void *arg)
+{
+    long misses = 0;
+    uint32_t key = (uintptr_t) arg;
+
+    rcu_register_thread();
+    while (!atomic_read(&stress_stop)) {
+        key = (key + 7) % (N_OBJS / 2);
+        rcu_read_lock();
+        if (qht_lookup(&stress_ht, test_cmp, &key, bad_hash(key)) !=
+            &objs[key]) {
+            misses++;
+        }
+        rcu_read_unlock();
+    }
+    rcu_unregister_thread();
+    atomic_add(&stress_misses, misses);
+    return NULL;
+}
+
+static void test_stress(void)
+{
+    QemuThread threads[STRESS_READERS];
+    int i, j;
+
+    init_objs();
+    qht_init(&stress_ht, 4, QHT_MODE_AUTO_RESIZE);
+    for (i = 0; i < N_OBJS / 2; i++) {
+        qht_insert(&stress_ht, &objs[i], bad_hash(i));
+    }
+
+    stress_stop = 0;
+    stress_misses = 0;
+    for (i = 0; i < STRESS_READERS; i++) {
+        qemu_thread_create(&threads[i], "qht-reader", stress_reader,
+                           (void *) (uintptr_t) i, QEMU_THREAD_JOINABLE);
+    }
+    for (j = 0; j < STRESS_ROUNDS; j++) {
+        for (i = N_OBJS / 2; i < N_OBJS; i++) {
+            g_assert(qht_insert(&stress_ht, &objs[i], bad_hash(i)));
+        }
+        for (i = N_OBJS / 2; i < N_OBJS; i++) {
+            g_assert(qht_remove(&stress_ht, &objs[i], bad_hash(i)));
+        }
+    }
+    atomic_set(&stress_stop, 1);
+    for (i = 0; i < STRESS_READERS; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+    g_assert_cmpint(stress_misses, ==, 0);
+
+    synchronize_rcu();
+    qht_destroy(&stress_ht);
+}
+
+/*
+ * Lookup throughput against the table QHT replaced for translation blocks:
+ * a fixed array of singly linked chains that moves every hit to the front,
+ * and so needs a lock even for lookups.
+ */
+#define BENCH_OBJS      (64 * 1024)
+#define BENCH_BUCKETS   (32 * 1024)
+#define BENCH_THREADS   4
+
+typedef struct BenchObj {
+    uint32_t key;
+    struct BenchObj *next;
+} BenchObj;
+
+static BenchObj *bench_objs;
+static BenchObj **mtf_heads;
+static QemuMutex mtf_lock;
+static QHT bench_ht;
+static bool bench_use_qht;
+static int bench_stop;
+static long bench_lookups;
+
+static BenchObj *mtf_lookup(uint32_t key)
+{
+    BenchObj **head = &mtf_heads[test_hash(key) & (BENCH_BUCKETS - 1)];
+    BenchObj **pp;
+    BenchObj *p;
+
+    for (pp = head; (p = *pp) != NULL; pp = &p->next) {
+        if (p->key == key) {
+            *pp = p->next;
+            p->next = *head;
+            *head = p;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static void *bench_thread(void *arg)
+{
+    uint32_t key = (uintptr_t) arg;
+    long n = 0;
+    int i;
+
+    rcu_register_thread();
+    while (!atomic_read(&bench_stop)) {
+        for (i = 0; i < 1000; i++) {
+            BenchObj *p;
+
+            key = (key + 40503) % BENCH_OBJS;
+            if (bench_use_qht) {
+                rcu_read_lock();
+                p = qht_lookup(&bench_ht, test_cmp, &key, test_hash(key));
+                rcu_read_unlock();
+            } else {
+                qemu_mutex_lock(&mtf_lock);
+                p = mtf_lookup(key);
+                qemu_mutex_unlock(&mtf_lock);
+            }
+            g_assert(p == &bench_objs[key]);
+        }
+        n += i;
+    }
+    rcu_unregister_thread();
+    atomic_add(&bench_lookups, n);
+    return NULL;
+}
+
+static void bench_run(const char *name, bool use_qht, int n_threads)
+{
+    QemuThread threads[BENCH_THREADS];
+    int64_t start, elapsed;
+    int i;
+
+    bench_use_qht = use_qht;
+    bench_stop = 0;
+    bench_lookups = 0;
+    start = g_get_monotonic_time();
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_create(&threads[i], "qht-bench", bench_thread,
+                           (void *) (uintptr_t) (i * 997),
+                           QEMU_THREAD_JOINABLE);
+    }
+    g_usleep(G_USEC_PER_SEC);
+    atomic_set(&bench_stop, 1);
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+    elapsed = g_get_monotonic_time() - start;
+
+    g_test_message("%s, %d threads: %.1f Mlookups/sec, %.1f ns/lookup",
+                   name, n_threads, (double) bench_lookups / elapsed,
+                   elapsed * 1000.0 * n_threads / bench_lookups);
+}
+
+static void test_bench(void)
+{
+    int i;
+
+    bench_objs = g_new0(BenchObj, BENCH_OBJS);
+    mtf_heads = g_new0(BenchObj *, BENCH_BUCKETS);
+    qemu_mutex_init(&mtf_lock);
+    qht_init(&bench_ht, BENCH_OBJS, QHT_MODE_AUTO_RESIZE);
+    for (i = 0; i < BENCH_OBJS; i++) {
+        BenchObj **head = &mtf_heads[test_hash(i) & (BENCH_BUCKETS - 1)];
+
+        bench_objs[i].key = i;
+        bench_objs[i].next = *head;
+        *head = &bench_objs[i];
+        qht_insert(&bench_ht, &bench_objs[i], test_hash(i));
+    }
+
+    bench_run("move-to-front chains", false, 1);
+    bench_run("qht", true, 1);
+    bench_run("move-to-front chains", false, BENCH_THREADS);
+    bench_run("qht", true, BENCH_THREADS);
+
+    qht_destroy(&bench_ht);
+    qemu_mutex_destroy(&mtf_lock);
+    g_free(mtf_heads);
+    g_free(bench_objs);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/qht/basic", test_basic);
+    g_test_add_func("/qht/chains", test_chains);
+    g_test_add_func("/qht/resize", test_resize);
+    g_test_add_func("/qht/stress", test_stress);
+    if (g_test_perf()) {
+        g_test_add_func("/qht/bench", test_bench);
+    }
+
+    return g_test_run();
+}
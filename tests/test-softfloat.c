@@ -0,0 +1,334 @@
+/*
+ * softfloat host FPU fast path tests.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+#include <glib.h>
+#include "qemu-common.h"
+#include "fpu/softfloat.h"
+
+#define N_RANDOM 200000
+
+typedef enum {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_SQRT,
+    N_OPS
+} Op;
+
+static const char *op_names[N_OPS] = { "add", "sub", "mul", "div", "sqrt" };
+
+static const int rounding_modes[] = {
+    float_round_nearest_even,
+    float_round_down,
+    float_round_up,
+    float_round_to_zero,
+};
+
+static uint32_t f32_specials[] = {
+    0x00000000, 0x80000000,             /* zeros */
+    0x00000001, 0x807fffff,             /* denormals */
+    0x00800000, 0x80800001,             /* smallest normals */
+    0x7f7fffff, 0xff7ffffe,             /* largest normals */
+    0x3f800000, 0xbf800000,             /* +-1 */
+    0x7f800000, 0xff800000,             /* infinities */
+    0x7fc00000, 0x7f800001,             /* NaNs */
+};
+
+static uint64_t f64_specials[] = {
+    0x0000000000000000ULL, 0x8000000000000000ULL,
+    0x0000000000000001ULL, 0x800fffffffffffffULL,
+    0x0010000000000000ULL, 0x8010000000000001ULL,
+    0x7fefffffffffffffULL, 0xffeffffffffffffeULL,
+    0x3ff0000000000000ULL, 0xbff0000000000000ULL,
+    0x7ff0000000000000ULL, 0xfff0000000000000ULL,
+    0x7ff8000000000000ULL, 0x7ff0000000000001ULL,
+};
+
+static uint64_t rand64(void)
+{
+    return ((uint64_t) g_test_rand_int() << 32) | g_test_rand_int();
+}
+
+/*
+ * Mostly normal numbers whose exponents are close enough for the result to
+ * be interesting, plus some near the ends of the exponent range.
+ */
+static uint32_t rand_f32(uint32_t other)
+{
+    uint32_t r = g_test_rand_int();
+    uint32_t e;
+
+    switch (g_test_rand_int_range(0, 8)) {
+    case 0:
+        return f32_specials[r % ARRAY_SIZE(f32_specials)];
+    case 1:
+        /* close to @other, for cancellation */
+        return other ^ (r & 0xf);
+    case 2:
+        /* exponent near the top or the bottom */
+        e = r & 0x80 ? 0xf0 + (r & 0xf) : r & 0xf;
+        return (r & 0x807fffff) | (e << 23);
+    default:
+        /* exponent within 32 of the middle */
+        e = 0x5f + ((r >> 23) & 0x3f);
+        return (r & 0x807fffff) | (e << 23);
+    }
+}
+
+static uint64_t rand_f64(uint64_t other)
+{
+    uint64_t r = rand64();
+    uint64_t e;
+
+    switch (g_test_rand_int_range(0, 8)) {
+    case 0:
+        return f64_specials[r % ARRAY_SIZE(f64_specials)];
+    case 1:
+        return other ^ (r & 0xf);
+    case 2:
+        e = r & 0x80 ? 0x7f0 + (r & 0xf) : r & 0xf;
+        return (r & 0x800fffffffffffffULL) | (e << 52);
+    default:
+        e = 0x3df + ((r >> 52) & 0x3f);
+        return (r & 0x800fffffffffffffULL) | (e << 52);
+    }
+}
+
+static float32 do_f32(Op op, float32 a, float32 b, float_status *s)
+{
+    switch (op) {
+    case OP_ADD:
+        return float32_add(a, b, s);
+    case OP_SUB:
+        return float32_sub(a, b, s);
+    case OP_MUL:
+        return float32_mul(a, b, s);
+    case OP_DIV:
+        return float32_div(a, b, s);
+    case OP_SQRT:
+        return float32_sqrt(a, s);
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static float64 do_f64(Op op, float64 a, float64 b, float_status *s)
+{
+    switch (op) {
+    case OP_ADD:
+        return float64_add(a, b, s);
+    case OP_SUB:
+        return float64_sub(a, b, s);
+    case OP_MUL:
+        return float64_mul(a, b, s);
+    case OP_DIV:
+        return float64_div(a, b, s);
+    case OP_SQRT:
+        return float64_sqrt(a, s);
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/*
+ * @fast ignores inexact or has it set already, so it may take the host FPU
+ * path; @ref starts with no flags and never does.  Every flag that @fast
+ * does not ignore must come out the same.
+ */
+static void check_f32(Op op, uint32_t a, uint32_t b, int rounding,
+                      flag sticky_inexact)
+{
+    float_status ref = { 0 }, fast = { 0 };
+    uint32_t r1, r2;
+    int mask = ~0;
+
+    set_float_rounding_mode(rounding, &ref);
+    set_float_rounding_mode(rounding, &fast);
+    if (sticky_inexact) {
+        set_float_exception_flags(float_flag_inexact, &fast);
+    } else {
+        set_float_ignore_inexact(true, &fast);
+        mask = ~float_flag_inexact;
+    }
+
+    r1 = float32_val(do_f32(op, make_float32(a), make_float32(b), &ref));
+    r2 = float32_val(do_f32(op, make_float32(a), make_float32(b), &fast));
+    if (sticky_inexact) {
+        float_raise(float_flag_inexact, &ref);
+    }
+    if (r1 != r2 || (get_float_exception_flags(&ref) & mask) !=
+                    (get_float_exception_flags(&fast) & mask)) {
+        g_test_message("float32_%s(%08x, %08x) rounding %d: "
+                       "%08x flags %x, host FPU path %08x flags %x",
+                       op_names[op], a, b, rounding,
+                       r1, get_float_exception_flags(&ref),
+                       r2, get_float_exception_flags(&fast));
+        g_assert_not_reached();
+    }
+}
+
+static void check_f64(Op op, uint64_t a, uint64_t b, int rounding,
+                      flag sticky_inexact)
+{
+    float_status ref = { 0 }, fast = { 0 };
+    uint64_t r1, r2;
+    int mask = ~0;
+
+    set_float_rounding_mode(rounding, &ref);
+    set_float_rounding_mode(rounding, &fast);
+    if (sticky_inexact) {
+        set_float_exception_flags(float_flag_inexact, &fast);
+    } else {
+        set_float_ignore_inexact(true, &fast);
+        mask = ~float_flag_inexact;
+    }
+
+    r1 = float64_val(do_f64(op, make_float64(a), make_float64(b), &ref));
+    r2 = float64_val(do_f64(op, make_float64(a), make_float64(b), &fast));
+    if (sticky_inexact) {
+        float_raise(float_flag_inexact, &ref);
+    }
+    if (r1 != r2 || (get_float_exception_flags(&ref) & mask) !=
+                    (get_float_exception_flags(&fast) & mask)) {
+        g_test_message("float64_%s(%016" PRIx64 ", %016" PRIx64 ") "
+                       "rounding %d: %016" PRIx64 " flags %x, "
+                       "host FPU path %016" PRIx64 " flags %x",
+                       op_names[op], a, b, rounding,
+                       r1, get_float_exception_flags(&ref),
+                       r2, get_float_exception_flags(&fast));
+        g_assert_not_reached();
+    }
+}
+
+static void test_f32_specials(void)
+{
+    int op, i, j, k;
+
+    for (op = 0; op < N_OPS; op++) {
+        for (i = 0; i < ARRAY_SIZE(f32_specials); i++) {
+            for (j = 0; j < ARRAY_SIZE(f32_specials); j++) {
+                for (k = 0; k < ARRAY_SIZE(rounding_modes); k++) {
+                    check_f32(op, f32_specials[i], f32_specials[j],
+                              rounding_modes[k], false);
+                    check_f32(op, f32_specials[i], f32_specials[j],
+                              rounding_modes[k], true);
+                }
+            }
+        }
+    }
+}
+
+static void test_f64_specials(void)
+{
+    int op, i, j, k;
+
+    for (op = 0; op < N_OPS; op++) {
+        for (i = 0; i < ARRAY_SIZE(f64_specials); i++) {
+            for (j = 0; j < ARRAY_SIZE(f64_specials); j++) {
+                for (k = 0; k < ARRAY_SIZE(rounding_modes); k++) {
+                    check_f64(op, f64_specials[i], f64_specials[j],
+                              rounding_modes[k], false);
+                    check_f64(op, f64_specials[i], f64_specials[j],
+                              rounding_modes[k], true);
+                }
+            }
+        }
+    }
+}
+
+static void test_f32_random(void)
+{
+    int op, i;
+
+    for (op = 0; op < N_OPS; op++) {
+        for (i = 0; i < N_RANDOM; i++) {
+            uint32_t a = rand_f32(0);
+            uint32_t b = rand_f32(a);
+            int rounding = rounding_modes[i % ARRAY_SIZE(rounding_modes)];
+
+            check_f32(op, a, b, rounding, i & 4);
+        }
+    }
+}
+
+static void test_f64_random(void)
+{
+    int op, i;
+
+    for (op = 0; op < N_OPS; op++) {
+        for (i = 0; i < N_RANDOM; i++) {
+            uint64_t a = rand_f64(0);
+            uint64_t b = rand_f64(a);
+            int rounding = rounding_modes[i % ARRAY_SIZE(rounding_modes)];
+
+            check_f64(op, a, b, rounding, i & 4);
+        }
+    }
+}
+
+/* Throughput on normal inputs, with and without the host FPU path */
+#define BENCH_INPUTS 4096
+
+static void bench_run(Op op, const uint64_t *in, flag ignore_inexact)
+{
+    float_status s = { 0 };
+    uint64_t acc = 0;
+    int64_t start, elapsed;
+    long n = 0;
+    int i;
+
+    set_float_ignore_inexact(ignore_inexact, &s);
+    start = g_get_monotonic_time();
+    do {
+        for (i = 0; i < BENCH_INPUTS; i += 2) {
+            /* A sticky inexact flag would let softfloat take the host
+               FPU path as well */
+            if (!ignore_inexact) {
+                set_float_exception_flags(0, &s);
+            }
+            acc += float64_val(do_f64(op, make_float64(in[i]),
+                                      make_float64(in[i + 1]), &s));
+        }
+        n += BENCH_INPUTS / 2;
+        elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < G_USEC_PER_SEC / 2);
+
+    g_test_message("float64_%s, %s: %.1f Mops/sec (%" PRIx64 ")",
+                   op_names[op], ignore_inexact ? "host FPU" : "softfloat",
+                   (double) n / elapsed, acc);
+}
+
+static void test_bench(void)
+{
+    uint64_t *in = g_new(uint64_t, BENCH_INPUTS);
+    int op, i;
+
+    for (i = 0; i < BENCH_INPUTS; i++) {
+        in[i] = (rand64() & 0x800fffffffffffffULL) |
+                ((uint64_t) (0x3df + (g_test_rand_int() & 0x3f)) << 52);
+    }
+    for (op = 0; op < N_OPS; op++) {
+        bench_run(op, in, false);
+        bench_run(op, in, true);
+    }
+    g_free(in);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/softfloat/f32/specials", test_f32_specials);
+    g_test_add_func("/softfloat/f64/specials", test_f64_specials);
+    g_test_add_func("/softfloat/f32/random", test_f32_random);
+    g_test_add_func("/softfloat/f64/random", test_f64_random);
+    if (g_test_perf()) {
+        g_test_add_func("/softfloat/bench", test_bench);
+    }
+
+    return g_test_run();
+}
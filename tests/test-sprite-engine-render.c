@@ -0,0 +1,195 @@
+/*
+ * Sprite engine reference renderer unit tests.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+#include <glib.h>
+#include "qemu-common.h"
+#include "hw/sprite-engine/sprite_engine_render.h"
+
+#define STRIDE  (SE_RENDER_WIDTH * sizeof(uint32_t))
+
+static uint32_t pixel(const uint32_t *fb, int x, int y)
+{
+    return fb[y * SE_RENDER_WIDTH + x];
+}
+
+static void set_colour(SERenderer *r, int palette, int colour, uint32_t rgb)
+{
+    union SECommand cmd;
+
+    fillUpdateCRAM(palette * SE_RENDER_COLOURS, (colour << 28) | rgb,
+                   &cmd.update_cram);
+    se_render_apply(r, &cmd);
+}
+
+static void set_pixel(SERenderer *r, int chunk, int x, int y, int colour)
+{
+    union SECommand cmd;
+
+    fillUpdateVRAM(0, (chunk << 23) | (y << 17) | (x << 11) | colour,
+                   &cmd.update_vram);
+    se_render_apply(r, &cmd);
+}
+
+/* An OAM window object showing a whole chunk */
+static void set_object(SERenderer *r, int index, int palette, int x, int y,
+                       bool flip_x)
+{
+    union SECommand cmd;
+
+    fillUpdateOAM(index, 0x80000000 | (palette << 24) |
+                  (flip_x ? 0x00200000 : 0) | (x << 10) | y,
+                  &cmd.update_oam);
+    se_render_apply(r, &cmd);
+}
+
+/* An instance showing 8 << size pixels of chunk sprite */
+static void set_instance(SERenderer *r, int index, int palette, int x, int y,
+                         int size, int sprite)
+{
+    union SECommand cmd;
+    uint64_t val = (1ULL << 63) | ((uint64_t) palette << 56) |
+                   ((uint64_t) x << 42) | ((uint64_t) y << 32) |
+                   (size << 5) | (sprite << 1);
+
+    fillUpdateInstOAM(SE_RENDER_INST_BASE + index, val, &cmd.update_oam);
+    se_render_apply(r, &cmd);
+}
+
+static void test_object(void)
+{
+    SERenderer r;
+    uint32_t *fb = g_new(uint32_t, SE_RENDER_WIDTH * SE_RENDER_HEIGHT);
+
+    se_render_init(&r);
+    set_colour(&r, 1, 3, 0x123456);
+    set_pixel(&r, 5, 0, 0, 3);
+    set_pixel(&r, 5, 10, 20, 3);
+    set_object(&r, 5, 1, 100, 50, false);
+    g_assert(r.dirty);
+
+    se_render_frame(&r, fb, STRIDE);
+    g_assert(!r.dirty);
+    g_assert_cmphex(pixel(fb, 100, 50), ==, 0x123456);
+    g_assert_cmphex(pixel(fb, 110, 70), ==, 0x123456);
+    /* Colour 0 is transparent */
+    g_assert_cmphex(pixel(fb, 101, 50), ==, 0);
+
+    /* Flipped horizontally, the first column moves to the last one */
+    set_object(&r, 5, 1, 100, 50, true);
+    se_render_frame(&r, fb, STRIDE);
+    g_assert_cmphex(pixel(fb, 100, 50), ==, 0);
+    g_assert_cmphex(pixel(fb, 100 + SE_RENDER_CHUNK_DIM - 1, 50), ==,
+                    0x123456);
+
+    se_render_cleanup(&r);
+    g_free(fb);
+}
+
+static void test_clip(void)
+{
+    SERenderer r;
+    uint32_t *fb = g_new(uint32_t, SE_RENDER_WIDTH * SE_RENDER_HEIGHT);
+    int x, y;
+
+    se_render_init(&r);
+    set_colour(&r, 0, 1, 0xffffff);
+    for (y = 0; y < SE_RENDER_CHUNK_DIM; y++) {
+        for (x = 0; x < SE_RENDER_CHUNK_DIM; x++) {
+            set_pixel(&r, 0, x, y, 1);
+        }
+    }
+    set_object(&r, 0, 0, SE_RENDER_WIDTH - 8, SE_RENDER_HEIGHT - 8, false);
+    set_object(&r, 1, 0, 1000, 1000, false);
+
+    se_render_frame(&r, fb, STRIDE);
+    g_assert_cmphex(pixel(fb, SE_RENDER_WIDTH - 1, SE_RENDER_HEIGHT - 1), ==,
+                    0xffffff);
+    g_assert_cmphex(pixel(fb, SE_RENDER_WIDTH - 9, SE_RENDER_HEIGHT - 1), ==,
+                    0);
+
+    se_render_cleanup(&r);
+    g_free(fb);
+}
+
+static void test_priority(void)
+{
+    SERenderer r;
+    uint32_t *fb = g_new(uint32_t, SE_RENDER_WIDTH * SE_RENDER_HEIGHT);
+    union SECommand cmd;
+
+    se_render_init(&r);
+    set_colour(&r, 0, 1, 0x0000ff);
+    set_colour(&r, 1, 1, 0x00ff00);
+    set_pixel(&r, 0, 0, 0, 1);
+    set_pixel(&r, 2, 0, 0, 1);
+    /* Object 0 and instance 0 (chunk 2, 8x8) both cover (0, 0) */
+    set_object(&r, 0, 0, 0, 0, false);
+    set_instance(&r, 0, 1, 0, 0, 0, 2);
+
+    se_render_frame(&r, fb, STRIDE);
+    g_assert_cmphex(pixel(fb, 0, 0), ==, 0x0000ff);
+
+    fillPriorityControl(1, &cmd.set_priority_control);
+    se_render_apply(&r, &cmd);
+    se_render_frame(&r, fb, STRIDE);
+    g_assert_cmphex(pixel(fb, 0, 0), ==, 0x00ff00);
+
+    se_render_cleanup(&r);
+    g_free(fb);
+}
+
+/* Every object and instance enabled with full chunks of opaque pixels */
+static void test_bench(void)
+{
+    SERenderer r;
+    uint32_t *fb = g_new(uint32_t, SE_RENDER_WIDTH * SE_RENDER_HEIGHT);
+    int64_t start, elapsed;
+    unsigned frames = 0;
+    int i, x, y;
+
+    se_render_init(&r);
+    for (i = 0; i < SE_RENDER_COLOURS; i++) {
+        set_colour(&r, 0, i, i * 0x111111);
+    }
+    for (i = 0; i < SE_RENDER_INST_BASE; i++) {
+        for (y = 0; y < SE_RENDER_CHUNK_DIM; y++) {
+            for (x = 0; x < SE_RENDER_CHUNK_DIM; x++) {
+                set_pixel(&r, i, x, y, (x + y + i) & 0xf);
+            }
+        }
+        set_object(&r, i, 0, (i * 37) % SE_RENDER_WIDTH,
+                   (i * 53) % SE_RENDER_HEIGHT, i & 1);
+        set_instance(&r, i, 0, (i * 41) % SE_RENDER_WIDTH,
+                     (i * 29) % SE_RENDER_HEIGHT, 3, i & 0xf);
+    }
+
+    start = g_get_monotonic_time();
+    do {
+        se_render_frame(&r, fb, STRIDE);
+        frames++;
+        elapsed = g_get_monotonic_time() - start;
+    } while (elapsed < G_USEC_PER_SEC);
+
+    g_test_message("%u frames in %" PRId64 " us, %.1f frames/sec",
+                   frames, elapsed, frames * (double) G_USEC_PER_SEC / elapsed);
+
+    se_render_cleanup(&r);
+    g_free(fb);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/sprite-engine-render/object", test_object);
+    g_test_add_func("/sprite-engine-render/clip", test_clip);
+    g_test_add_func("/sprite-engine-render/priority", test_priority);
+    if (g_test_perf()) {
+        g_test_add_func("/sprite-engine-render/bench", test_bench);
+    }
+
+    return g_test_run();
+}
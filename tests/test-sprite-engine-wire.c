@@ -0,0 +1,294 @@
+/*
+ * Sprite engine compact wire format unit tests.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+#include <glib.h>
+#include "qemu-common.h"
+#include "hw/sprite-engine/sprite_engine_wire.h"
+
+#define VRAM_CHUNKS 512
+#define VRAM_DIM    64
+
+typedef struct Model {
+    struct SECommandUpdateOAM oam[SE_WIRE_OAM_SLOTS];
+    struct SECommandUpdateCRAM cram[256];
+    uint8_t vram[VRAM_CHUNKS][VRAM_DIM][VRAM_DIM];
+    bool iprctl;
+    unsigned commands;
+} Model;
+
+static void model_apply(void *opaque, const union SECommand *cmd)
+{
+    Model *m = opaque;
+
+    m->commands++;
+    switch (cmd->type) {
+    case UPDATE_OAM:
+        m->oam[cmd->update_oam.oam_index] = cmd->update_oam;
+        m->oam[cmd->update_oam.oam_index].vsync_count = 0;
+        break;
+    case SET_PRIORITY_CTRL:
+        m->iprctl = cmd->set_priority_control.iprctl;
+        break;
+    case UPDATE_CRAM:
+        m->cram[cmd->update_cram.cram_index] = cmd->update_cram;
+        break;
+    case UPDATE_VRAM:
+        m->vram[cmd->update_vram.chunk][cmd->update_vram.pixel_y]
+               [cmd->update_vram.pixel_x] = cmd->update_vram.p_data;
+        break;
+    }
+}
+
+static void assert_oam_equal(const struct SECommandUpdateOAM *a,
+                             const struct SECommandUpdateOAM *b)
+{
+    g_assert_cmpint(a->oam_index, ==, b->oam_index);
+    g_assert_cmpint(a->enable, ==, b->enable);
+    g_assert_cmpint(a->palette, ==, b->palette);
+    g_assert_cmpint(a->flip_x, ==, b->flip_x);
+    g_assert_cmpint(a->flip_y, ==, b->flip_y);
+    g_assert_cmpint(a->x_offset, ==, b->x_offset);
+    g_assert_cmpint(a->y_offset, ==, b->y_offset);
+    g_assert_cmpint(a->sprite_size, ==, b->sprite_size);
+    g_assert_cmpint(a->sprite, ==, b->sprite);
+    g_assert_cmpint(a->transpose, ==, b->transpose);
+}
+
+static void assert_cram_equal(const struct SECommandUpdateCRAM *a,
+                              const struct SECommandUpdateCRAM *b)
+{
+    g_assert_cmpint(a->cram_index, ==, b->cram_index);
+    g_assert_cmpint(a->palette_index, ==, b->palette_index);
+    g_assert_cmpint(a->user, ==, b->user);
+    g_assert_cmpint(a->red, ==, b->red);
+    g_assert_cmpint(a->green, ==, b->green);
+    g_assert_cmpint(a->blue, ==, b->blue);
+}
+
+typedef struct Stream {
+    SEWireEncoder enc;
+    uint8_t *data;
+    size_t len;
+} Stream;
+
+static void stream_init(Stream *s, size_t packet_size)
+{
+    se_wire_encoder_init(&s->enc, packet_size);
+    s->data = NULL;
+    s->len = 0;
+}
+
+static void stream_finish(Stream *s)
+{
+    size_t len = se_wire_encoder_finish(&s->enc);
+
+    s->data = g_realloc(s->data, s->len + len);
+    memcpy(s->data + s->len, s->enc.buf, len);
+    s->len += len;
+}
+
+static void stream_put(Stream *s, const union SECommand *cmd, uint32_t count)
+{
+    if (!se_wire_encode(&s->enc, cmd, count)) {
+        stream_finish(s);
+        g_assert(se_wire_encode(&s->enc, cmd, count));
+    }
+}
+
+static void stream_cleanup(Stream *s)
+{
+    se_wire_encoder_cleanup(&s->enc);
+    g_free(s->data);
+}
+
+static void stream_decode(Stream *s, Model *m)
+{
+    SEWireDecoder dec;
+    size_t off = 0;
+
+    se_wire_decoder_init(&dec);
+    while (off < s->len) {
+        ssize_t ret = se_wire_decode(&dec, s->data + off, s->len - off,
+                                     model_apply, m);
+        g_assert_cmpint(ret, >, 0);
+        off += ret;
+    }
+    g_assert_cmpint(off, ==, s->len);
+}
+
+static void random_command(union SECommand *cmd)
+{
+    uint32_t val = g_test_rand_int();
+
+    memset(cmd, 0, sizeof(*cmd));
+    switch (g_test_rand_int_range(0, 4)) {
+    case 0:
+        fillUpdateOAM(g_test_rand_int_range(0, 124), val, &cmd->update_oam);
+        break;
+    case 1:
+        fillUpdateInstOAM(g_test_rand_int_range(128, 256),
+                          ((uint64_t) val << 32) | g_test_rand_int(),
+                          &cmd->update_oam);
+        break;
+    case 2:
+        fillUpdateCRAM(g_test_rand_int_range(0, 64), val, &cmd->update_cram);
+        break;
+    case 3:
+        fillPriorityControl(val, &cmd->set_priority_control);
+        break;
+    }
+}
+
+static void test_round_trip(void)
+{
+    Model *expect = g_new0(Model, 1);
+    Model *got = g_new0(Model, 1);
+    union SECommand cmd;
+    Stream s;
+    int i, frame;
+
+    stream_init(&s, 256);
+    for (frame = 0; frame < 16; frame++) {
+        for (i = 0; i < 500; i++) {
+            if (g_test_rand_bit()) {
+                random_command(&cmd);
+            } else {
+                /* Mostly sequential pixels, with a jump now and then */
+                uint32_t chunk = g_test_rand_int_range(0, 4);
+                uint32_t x = (i % 80) < VRAM_DIM ? i % 80 : 0;
+                fillUpdateVRAM(0, (chunk << 23) | ((frame & 63) << 17) |
+                               (x << 11) | (g_test_rand_int() & 0xf),
+                               &cmd.update_vram);
+            }
+            model_apply(expect, &cmd);
+            stream_put(&s, &cmd, frame);
+        }
+        stream_finish(&s);
+    }
+
+    stream_decode(&s, got);
+    for (i = 0; i < SE_WIRE_OAM_SLOTS; i++) {
+        assert_oam_equal(&expect->oam[i], &got->oam[i]);
+    }
+    for (i = 0; i < ARRAY_SIZE(expect->cram); i++) {
+        assert_cram_equal(&expect->cram[i], &got->cram[i]);
+    }
+    g_assert(memcmp(expect->vram, got->vram, sizeof(expect->vram)) == 0);
+    g_assert(expect->iprctl == got->iprctl);
+
+    stream_cleanup(&s);
+    g_free(expect);
+    g_free(got);
+}
+
+static void test_vram_run(void)
+{
+    Model *got = g_new0(Model, 1);
+    union SECommand cmd;
+    Stream s;
+    int x;
+
+    stream_init(&s, 4096);
+    for (x = 0; x < VRAM_DIM; x++) {
+        fillUpdateVRAM(0, (7 << 23) | (3 << 17) | (x << 11) | (x & 0xf),
+                       &cmd.update_vram);
+        stream_put(&s, &cmd, 0);
+    }
+    stream_finish(&s);
+
+    /* One header, one run record holding a full row of nibbles */
+    g_assert_cmpint(s.len, ==, SE_WIRE_HEADER_SIZE + 6 + VRAM_DIM / 2);
+
+    stream_decode(&s, got);
+    g_assert_cmpint(got->commands, ==, VRAM_DIM);
+    for (x = 0; x < VRAM_DIM; x++) {
+        g_assert_cmpint(got->vram[7][3][x], ==, x & 0xf);
+    }
+
+    stream_cleanup(&s);
+    g_free(got);
+}
+
+static void test_oam_delta(void)
+{
+    Model *got = g_new0(Model, 1);
+    union SECommand cmd;
+    Stream s;
+    size_t first;
+
+    stream_init(&s, 4096);
+    fillUpdateOAM(5, 0x81000000 | (100 << 10) | 50, &cmd.update_oam);
+    stream_put(&s, &cmd, 0);
+    stream_finish(&s);
+    first = s.len;
+
+    /* Unchanged: nothing at all goes on the wire */
+    stream_put(&s, &cmd, 1);
+    stream_finish(&s);
+    g_assert_cmpint(s.len, ==, first);
+
+    /* Only x moved: opcode, index, mask and one u16 */
+    fillUpdateOAM(5, 0x81000000 | (101 << 10) | 50, &cmd.update_oam);
+    stream_put(&s, &cmd, 2);
+    stream_finish(&s);
+    g_assert_cmpint(s.len - first, ==, SE_WIRE_HEADER_SIZE + 5);
+
+    stream_decode(&s, got);
+    g_assert_cmpint(got->commands, ==, 2);
+    g_assert(got->oam[5].enable);
+    g_assert_cmpint(got->oam[5].palette, ==, 1);
+    g_assert_cmpint(got->oam[5].x_offset, ==, 101);
+    g_assert_cmpint(got->oam[5].y_offset, ==, 50);
+
+    stream_cleanup(&s);
+    g_free(got);
+}
+
+static void test_malformed(void)
+{
+    Model *got = g_new0(Model, 1);
+    SEWireDecoder dec;
+    union SECommand cmd;
+    Stream s;
+
+    stream_init(&s, 4096);
+    fillUpdateCRAM(9, 0x12345678, &cmd.update_cram);
+    stream_put(&s, &cmd, 0);
+    stream_finish(&s);
+
+    se_wire_decoder_init(&dec);
+    /* Truncated packets are not consumed */
+    g_assert_cmpint(se_wire_decode(&dec, s.data, SE_WIRE_HEADER_SIZE - 1,
+                                   model_apply, got), ==, 0);
+    g_assert_cmpint(se_wire_decode(&dec, s.data, s.len - 1,
+                                   model_apply, got), ==, 0);
+    g_assert_cmpint(got->commands, ==, 0);
+
+    /* Unknown opcode */
+    s.data[SE_WIRE_HEADER_SIZE] = 0xff;
+    g_assert_cmpint(se_wire_decode(&dec, s.data, s.len,
+                                   model_apply, got), ==, -1);
+
+    /* Bad magic */
+    s.data[0] ^= 0xff;
+    g_assert_cmpint(se_wire_decode(&dec, s.data, s.len,
+                                   model_apply, got), ==, -1);
+
+    stream_cleanup(&s);
+    g_free(got);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/sprite-engine-wire/round_trip", test_round_trip);
+    g_test_add_func("/sprite-engine-wire/vram_run", test_vram_run);
+    g_test_add_func("/sprite-engine-wire/oam_delta", test_oam_delta);
+    g_test_add_func("/sprite-engine-wire/malformed", test_malformed);
+
+    return g_test_run();
+}
@@ -127,36 +127,32 @@ static void *l1_map[V_L1_SIZE];
 TCGContext tcg_ctx;
 
 /* translation block context */
-#ifdef CONFIG_USER_ONLY
 __thread int have_tb_lock;
-#endif
 
+/* tb_lock protects the TB hash tables, the page lists and code generation,
+ * in system emulation as well as in user mode.  Executing translated code
+ * and looking TBs up in a CPU's tb_jmp_cache does not need it.
+ */
 void tb_lock(void)
 {
-#ifdef CONFIG_USER_ONLY
     assert(!have_tb_lock);
     qemu_mutex_lock(&tcg_ctx.tb_ctx.tb_lock);
     have_tb_lock++;
-#endif
 }
 
 void tb_unlock(void)
 {
-#ifdef CONFIG_USER_ONLY
     assert(have_tb_lock);
     have_tb_lock--;
     qemu_mutex_unlock(&tcg_ctx.tb_ctx.tb_lock);
-#endif
 }
 
 void tb_lock_reset(void)
 {
-#ifdef CONFIG_USER_ONLY
     if (have_tb_lock) {
         qemu_mutex_unlock(&tcg_ctx.tb_ctx.tb_lock);
         have_tb_lock = 0;
     }
-#endif
 }
 
 static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
@@ -722,21 +718,53 @@ static inline void *alloc_code_gen_buffer(void)
 
 static inline void code_gen_alloc(size_t tb_size)
 {
+    TBContext *tb_ctx = &tcg_ctx.tb_ctx;
+    size_t size, region_size;
+    int i, nb_blocks;
+
     tcg_ctx.code_gen_buffer_size = size_code_gen_buffer(tb_size);
     tcg_ctx.code_gen_buffer = alloc_code_gen_buffer();
     if (tcg_ctx.code_gen_buffer == NULL) {
         fprintf(stderr, "Could not allocate dynamic translator buffer\n");
         exit(1);
     }
+    size = tcg_ctx.code_gen_buffer_size;
 
     /* Estimate a good size for the number of TBs we can support.  We
        still haven't deducted the prologue from the buffer size here,
        but that's minimal and won't affect the estimate much.  */
-    tcg_ctx.code_gen_max_blocks
-        = tcg_ctx.code_gen_buffer_size / CODE_GEN_AVG_BLOCK_SIZE;
-    tcg_ctx.tb_ctx.tbs = g_new(TranslationBlock, tcg_ctx.code_gen_max_blocks);
+    nb_blocks = size / CODE_GEN_AVG_BLOCK_SIZE;
+
+    /* Regions smaller than the smallest buffer we accept would be
+       evicted too often to be worth it.  The prologue ends up at the
+       start of the first region.  */
+    tb_ctx->nb_regions = MAX(1, MIN(CODE_GEN_MAX_REGIONS,
+                                    size / MIN_CODE_GEN_BUFFER_SIZE));
+    region_size = QEMU_ALIGN_DOWN(size / tb_ctx->nb_regions, CODE_GEN_ALIGN);
+
+    /* Round the TBs of each region up to a power of two, so that the
+       region of a TB can be found with a shift.  */
+    tb_ctx->region_tbs_bits =
+        32 - clz32(DIV_ROUND_UP(nb_blocks, tb_ctx->nb_regions) - 1);
+    tcg_ctx.code_gen_max_blocks =
+        tb_ctx->nb_regions << tb_ctx->region_tbs_bits;
+    tb_ctx->tbs = g_new(TranslationBlock, tcg_ctx.code_gen_max_blocks);
+
+    for (i = 0; i < tb_ctx->nb_regions; i++) {
+        TBRegion *r = &tb_ctx->regions[i];
+
+        r->start = tcg_ctx.code_gen_buffer + i * region_size;
+        r->end = i == tb_ctx->nb_regions - 1
+                 ? tcg_ctx.code_gen_buffer + size : r->start + region_size;
+        r->ptr = r->start;
+        r->tbs = &tb_ctx->tbs[i << tb_ctx->region_tbs_bits];
+    }
+    tb_ctx->generation = 1;
+    tb_ctx->regions[0].last_used = tb_ctx->generation;
 
     qemu_mutex_init(&tcg_ctx.tb_ctx.tb_lock);
+    qht_init(&tcg_ctx.tb_ctx.htable, CODE_GEN_HTABLE_SIZE,
+             QHT_MODE_AUTO_RESIZE);
 }
 
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
@@ -759,30 +787,55 @@ bool tcg_enabled(void)
     return tcg_ctx.code_gen_buffer != NULL;
 }
 
-/* Allocate a new translation block. Flush the translation buffer if
-   too many translation blocks or too much generated code. */
+/* The first region also holds the prologue, which tcg_prologue_init
+   leaves out of code_gen_buffer.  */
+static inline void *tb_region_start(TBRegion *r)
+{
+    return MAX(r->start, tcg_ctx.code_gen_buffer);
+}
+
+/* End of the code generated so far in region @r.  */
+static inline void *tb_region_ptr(TBRegion *r)
+{
+    TBContext *tb_ctx = &tcg_ctx.tb_ctx;
+
+    return r == &tb_ctx->regions[tb_ctx->cur_region]
+           ? tcg_ctx.code_gen_ptr : r->ptr;
+}
+
+/* Allocate a new translation block in the current region.  Returns NULL
+   if the region has run out of translation blocks.  Running out of code
+   space is detected by tcg_gen_code.  */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
+    TBContext *tb_ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &tb_ctx->regions[tb_ctx->cur_region];
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs >= tcg_ctx.code_gen_max_blocks) {
+    if (r->nb_tbs >= (1 << tb_ctx->region_tbs_bits)) {
         return NULL;
     }
-    tb = &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs++];
+    tb = &r->tbs[r->nb_tbs++];
+    tb_ctx->nb_tbs++;
     tb->pc = pc;
     tb->cflags = 0;
+    tb->exec_count = 0;
+    tcg_ctx.code_gen_highwater = r->end - 1024;
     return tb;
 }
 
 void tb_free(TranslationBlock *tb)
 {
+    TBContext *tb_ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = &tb_ctx->regions[tb_ctx->cur_region];
+
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
-    if (tcg_ctx.tb_ctx.nb_tbs > 0 &&
-            tb == &tcg_ctx.tb_ctx.tbs[tcg_ctx.tb_ctx.nb_tbs - 1]) {
+    if (r->nb_tbs > 0 && tb == &r->tbs[r->nb_tbs - 1]) {
         tcg_ctx.code_gen_ptr = tb->tc_ptr;
-        tcg_ctx.tb_ctx.nb_tbs--;
+        r->nb_tbs--;
+        tb_ctx->nb_tbs--;
     }
 }
 
@@ -830,6 +883,8 @@ static void page_flush_tb(void)
 /* XXX: tb_flush is currently not thread safe */
 void tb_flush(CPUState *cpu)
 {
+    int i;
+
 #if defined(DEBUG_FLUSH)
     printf("qemu: flush code_size=%ld nb_tbs=%d avg_tb_size=%ld\n",
            (unsigned long)(tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer),
@@ -842,12 +897,21 @@ void tb_flush(CPUState *cpu)
         cpu_abort(cpu, "Internal error: code buffer overflow\n");
     }
     tcg_ctx.tb_ctx.nb_tbs = 0;
+    for (i = 0; i < tcg_ctx.tb_ctx.nb_regions; i++) {
+        TBRegion *r = &tcg_ctx.tb_ctx.regions[i];
+
+        r->ptr = r->start;
+        r->nb_tbs = 0;
+        r->last_used = 0;
+    }
+    tcg_ctx.tb_ctx.cur_region = 0;
+    tcg_ctx.tb_ctx.regions[0].last_used = tcg_ctx.tb_ctx.generation;
 
     CPU_FOREACH(cpu) {
         memset(cpu->tb_jmp_cache, 0, sizeof(cpu->tb_jmp_cache));
     }
 
-    memset(tcg_ctx.tb_ctx.tb_phys_hash, 0, sizeof(tcg_ctx.tb_ctx.tb_phys_hash));
+    qht_reset(&tcg_ctx.tb_ctx.htable);
     page_flush_tb();
 
     tcg_ctx.code_gen_ptr = tcg_ctx.code_gen_buffer;
@@ -858,59 +922,47 @@ void tb_flush(CPUState *cpu)
 
 #ifdef DEBUG_TB_CHECK
 
-static void tb_invalidate_check(target_ulong address)
+static void do_tb_invalidate_check(QHT *ht, void *p, uint32_t hash,
+                                   void *userp)
 {
-    TranslationBlock *tb;
-    int i;
+    TranslationBlock *tb = p;
+    target_ulong address = *(target_ulong *)userp;
 
-    address &= TARGET_PAGE_MASK;
-    for (i = 0; i < CODE_GEN_PHYS_HASH_SIZE; i++) {
-        for (tb = tb_ctx.tb_phys_hash[i]; tb != NULL; tb = tb->phys_hash_next) {
-            if (!(address + TARGET_PAGE_SIZE <= tb->pc ||
-                  address >= tb->pc + tb->size)) {
-                printf("ERROR invalidate: address=" TARGET_FMT_lx
-                       " PC=%08lx size=%04x\n",
-                       address, (long)tb->pc, tb->size);
-            }
-        }
+    if (!(address + TARGET_PAGE_SIZE <= tb->pc ||
+          address >= tb->pc + tb->size)) {
+        printf("ERROR invalidate: address=" TARGET_FMT_lx
+               " PC=%08lx size=%04x\n",
+               address, (long)tb->pc, tb->size);
     }
 }
 
-/* verify that all the pages have correct rights for code */
-static void tb_page_check(void)
+static void tb_invalidate_check(target_ulong address)
 {
-    TranslationBlock *tb;
-    int i, flags1, flags2;
-
-    for (i = 0; i < CODE_GEN_PHYS_HASH_SIZE; i++) {
-        for (tb = tcg_ctx.tb_ctx.tb_phys_hash[i]; tb != NULL;
-                tb = tb->phys_hash_next) {
-            flags1 = page_get_flags(tb->pc);
-            flags2 = page_get_flags(tb->pc + tb->size - 1);
-            if ((flags1 & PAGE_WRITE) || (flags2 & PAGE_WRITE)) {
-                printf("ERROR page flags: PC=%08lx size=%04x f1=%x f2=%x\n",
-                       (long)tb->pc, tb->size, flags1, flags2);
-            }
-        }
-    }
+    address &= TARGET_PAGE_MASK;
+    qht_iter(&tcg_ctx.tb_ctx.htable, do_tb_invalidate_check, &address);
 }
 
-#endif
-
-static inline void tb_hash_remove(TranslationBlock **ptb, TranslationBlock *tb)
+static void do_tb_page_check(QHT *ht, void *p, uint32_t hash, void *userp)
 {
-    TranslationBlock *tb1;
+    TranslationBlock *tb = p;
+    int flags1, flags2;
 
-    for (;;) {
-        tb1 = *ptb;
-        if (tb1 == tb) {
-            *ptb = tb1->phys_hash_next;
-            break;
-        }
-        ptb = &tb1->phys_hash_next;
+    flags1 = page_get_flags(tb->pc);
+    flags2 = page_get_flags(tb->pc + tb->size - 1);
+    if ((flags1 & PAGE_WRITE) || (flags2 & PAGE_WRITE)) {
+        printf("ERROR page flags: PC=%08lx size=%04x f1=%x f2=%x\n",
+               (long)tb->pc, tb->size, flags1, flags2);
     }
 }
 
+/* verify that all the pages have correct rights for code */
+static void tb_page_check(void)
+{
+    qht_iter(&tcg_ctx.tb_ctx.htable, do_tb_page_check, NULL);
+}
+
+#endif
+
 static inline void tb_page_remove(TranslationBlock **ptb, TranslationBlock *tb)
 {
     TranslationBlock *tb1;
@@ -973,10 +1025,14 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     tb_page_addr_t phys_pc;
     TranslationBlock *tb1, *tb2;
 
-    /* remove the TB from the hash list */
+    /* remove the TB from the hash list.  If it is not there, it has
+       already been invalidated and is only waiting for its region to be
+       evicted.  */
     phys_pc = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
-    h = tb_phys_hash_func(phys_pc);
-    tb_hash_remove(&tcg_ctx.tb_ctx.tb_phys_hash[h], tb);
+    if (!qht_remove(&tcg_ctx.tb_ctx.htable, tb,
+                    tb_hash_func(phys_pc, tb->pc, tb->flags))) {
+        return;
+    }
 
     /* remove the TB from the page list */
     if (tb->page_addr[0] != page_addr) {
@@ -1051,7 +1107,44 @@ static void build_page_bitmap(PageDesc *p)
     }
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
+/* Called when the current region is full.  Evict the region whose TBs
+   ran least recently, unlinking every jump into them, and carry on
+   translating there.  With a single region, this is just tb_flush.  */
+static void tb_evict_region(CPUState *cpu)
+{
+    TBContext *tb_ctx = &tcg_ctx.tb_ctx;
+    TBRegion *cur = &tb_ctx->regions[tb_ctx->cur_region];
+    TBRegion *r = NULL;
+    int i;
+
+    if (tb_ctx->nb_regions == 1) {
+        tb_flush(cpu);
+        return;
+    }
+
+    cur->ptr = tcg_ctx.code_gen_ptr;
+    for (i = 0; i < tb_ctx->nb_regions; i++) {
+        TBRegion *r1 = &tb_ctx->regions[i];
+
+        if (r1 != cur && (!r || r1->last_used < r->last_used)) {
+            r = r1;
+        }
+    }
+
+    for (i = 0; i < r->nb_tbs; i++) {
+        tb_phys_invalidate(&r->tbs[i], -1);
+    }
+    tb_ctx->nb_tbs -= r->nb_tbs;
+    r->nb_tbs = 0;
+    r->ptr = r->start;
+    r->last_used = ++tb_ctx->generation;
+
+    tb_ctx->cur_region = r - tb_ctx->regions;
+    tcg_ctx.code_gen_ptr = tb_region_start(r);
+    tb_ctx->tb_region_evict_count++;
+}
+
+/* Called with tb_lock held, and mmap_lock held for user mode emulation.  */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               int flags, int cflags)
@@ -1060,6 +1153,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     TranslationBlock *tb;
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
+
+    assert(have_tb_lock);
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size;
 #ifdef CONFIG_PROFILER
@@ -1070,12 +1165,18 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if (use_icount) {
         cflags |= CF_USE_ICOUNT;
     }
+    if (tcg_ctx.tb_ctx.profile) {
+        cflags |= CF_PROFILE;
+    }
 
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
  buffer_overflow:
-        /* flush must be done */
-        tb_flush(cpu);
+        if (tb) {
+            /* the code did not fit, give back the TB */
+            tb_free(tb);
+        }
+        tb_evict_region(cpu);
         /* cannot fail at this point */
         tb = tb_alloc(pc);
         assert(tb != NULL);
@@ -1292,7 +1393,9 @@ void tb_invalidate_phys_page_range(tb_page_addr_t start, tb_page_addr_t end,
            modifying the memory. It will ensure that it cannot modify
            itself */
         cpu->current_tb = NULL;
+        tb_lock();
         tb_gen_code(cpu, current_pc, current_cs_base, current_flags, 1);
+        tb_unlock();
         cpu_resume_from_signal(cpu, NULL);
     }
 #endif
@@ -1397,7 +1500,9 @@ static void tb_invalidate_phys_page(tb_page_addr_t addr,
            modifying the memory. It will ensure that it cannot modify
            itself */
         cpu->current_tb = NULL;
+        tb_lock();
         tb_gen_code(cpu, current_pc, current_cs_base, current_flags, 1);
+        tb_unlock();
         if (locked) {
             mmap_unlock();
         }
@@ -1473,15 +1578,6 @@ static inline void tb_alloc_page(TranslationBlock *tb,
 static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
                          tb_page_addr_t phys_page2)
 {
-    unsigned int h;
-    TranslationBlock **ptb;
-
-    /* add in the physical hash table */
-    h = tb_phys_hash_func(phys_pc);
-    ptb = &tcg_ctx.tb_ctx.tb_phys_hash[h];
-    tb->phys_hash_next = *ptb;
-    *ptb = tb;
-
     /* add in the page list */
     tb_alloc_page(tb, 0, phys_pc & TARGET_PAGE_MASK);
     if (phys_page2 != -1) {
@@ -1502,6 +1598,10 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
         tb_reset_jump(tb, 1);
     }
 
+    /* add in the hash table last, lookups do not take tb_lock */
+    qht_insert(&tcg_ctx.tb_ctx.htable, tb,
+               tb_hash_func(phys_pc, tb->pc, tb->flags));
+
 #ifdef DEBUG_TB_CHECK
     tb_page_check();
 #endif
@@ -1511,23 +1611,32 @@ static void tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
    tb[1].tc_ptr. Return NULL if not found */
 static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
 {
-    int m_min, m_max, m;
+    TBContext *tb_ctx = &tcg_ctx.tb_ctx;
+    TBRegion *r = NULL;
+    int i, m_min, m_max, m;
     uintptr_t v;
     TranslationBlock *tb;
 
-    if (tcg_ctx.tb_ctx.nb_tbs <= 0) {
+    for (i = 0; i < tb_ctx->nb_regions; i++) {
+        if (tc_ptr >= (uintptr_t)tb_ctx->regions[i].start &&
+            tc_ptr < (uintptr_t)tb_ctx->regions[i].end) {
+            r = &tb_ctx->regions[i];
+            break;
+        }
+    }
+    if (!r || r->nb_tbs <= 0) {
         return NULL;
     }
-    if (tc_ptr < (uintptr_t)tcg_ctx.code_gen_buffer ||
-        tc_ptr >= (uintptr_t)tcg_ctx.code_gen_ptr) {
+    if (tc_ptr < (uintptr_t)tb_region_start(r) ||
+        tc_ptr >= (uintptr_t)tb_region_ptr(r)) {
         return NULL;
     }
     /* binary search (cf Knuth) */
     m_min = 0;
-    m_max = tcg_ctx.tb_ctx.nb_tbs - 1;
+    m_max = r->nb_tbs - 1;
     while (m_min <= m_max) {
         m = (m_min + m_max) >> 1;
-        tb = &tcg_ctx.tb_ctx.tbs[m];
+        tb = &r->tbs[m];
         v = (uintptr_t)tb->tc_ptr;
         if (v == tc_ptr) {
             return tb;
@@ -1537,7 +1646,7 @@ static TranslationBlock *tb_find_pc(uintptr_t tc_ptr)
             m_min = m + 1;
         }
     }
-    return &tcg_ctx.tb_ctx.tbs[m_max];
+    return &r->tbs[m_max];
 }
 
 #if !defined(CONFIG_USER_ONLY)
@@ -1597,6 +1706,7 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
     target_ulong pc, cs_base;
     uint64_t flags;
 
+    tb_lock();
     tb = tb_find_pc(retaddr);
     if (!tb) {
         cpu_abort(cpu, "cpu_io_recompile: could not find TB for pc=%p",
@@ -1648,6 +1758,7 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
     /* FIXME: In theory this could raise an exception.  In practice
        we have already translated the block once so it's probably ok.  */
     tb_gen_code(cpu, pc, cs_base, flags, cflags);
+    tb_unlock();
     /* TODO: If env->pc != tb->pc (i.e. the faulting instruction was not
        the first in the TB) then we end up generating a whole new TB and
        repeating the fault, which is horribly inefficient.
@@ -1673,8 +1784,10 @@ void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
 
 void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
-    int i, target_code_size, max_target_code_size;
+    TBContext *tb_ctx = &tcg_ctx.tb_ctx;
+    int i, j, target_code_size, max_target_code_size;
     int direct_jmp_count, direct_jmp2_count, cross_page;
+    ptrdiff_t gen_code_size;
     TranslationBlock *tb;
 
     target_code_size = 0;
@@ -1682,40 +1795,40 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cross_page = 0;
     direct_jmp_count = 0;
     direct_jmp2_count = 0;
-    for (i = 0; i < tcg_ctx.tb_ctx.nb_tbs; i++) {
-        tb = &tcg_ctx.tb_ctx.tbs[i];
-        target_code_size += tb->size;
-        if (tb->size > max_target_code_size) {
-            max_target_code_size = tb->size;
-        }
-        if (tb->page_addr[1] != -1) {
-            cross_page++;
-        }
-        if (tb->tb_next_offset[0] != 0xffff) {
-            direct_jmp_count++;
-            if (tb->tb_next_offset[1] != 0xffff) {
-                direct_jmp2_count++;
+    gen_code_size = 0;
+    for (j = 0; j < tb_ctx->nb_regions; j++) {
+        TBRegion *r = &tb_ctx->regions[j];
+
+        gen_code_size += tb_region_ptr(r) - tb_region_start(r);
+        for (i = 0; i < r->nb_tbs; i++) {
+            tb = &r->tbs[i];
+            target_code_size += tb->size;
+            if (tb->size > max_target_code_size) {
+                max_target_code_size = tb->size;
+            }
+            if (tb->page_addr[1] != -1) {
+                cross_page++;
+            }
+            if (tb->tb_next_offset[0] != 0xffff) {
+                direct_jmp_count++;
+                if (tb->tb_next_offset[1] != 0xffff) {
+                    direct_jmp2_count++;
+                }
             }
         }
     }
     /* XXX: avoid using doubles ? */
     cpu_fprintf(f, "Translation buffer state:\n");
     cpu_fprintf(f, "gen code size       %td/%zd\n",
-                tcg_ctx.code_gen_ptr - tcg_ctx.code_gen_buffer,
-                tcg_ctx.code_gen_highwater - tcg_ctx.code_gen_buffer);
+                gen_code_size, tcg_ctx.code_gen_buffer_size);
     cpu_fprintf(f, "TB count            %d/%d\n",
-            tcg_ctx.tb_ctx.nb_tbs, tcg_ctx.code_gen_max_blocks);
+            tb_ctx->nb_tbs, tcg_ctx.code_gen_max_blocks);
     cpu_fprintf(f, "TB avg target size  %d max=%d bytes\n",
-            tcg_ctx.tb_ctx.nb_tbs ? target_code_size /
-                    tcg_ctx.tb_ctx.nb_tbs : 0,
+            tb_ctx->nb_tbs ? target_code_size / tb_ctx->nb_tbs : 0,
             max_target_code_size);
     cpu_fprintf(f, "TB avg host size    %td bytes (expansion ratio: %0.1f)\n",
-            tcg_ctx.tb_ctx.nb_tbs ? (tcg_ctx.code_gen_ptr -
-                                     tcg_ctx.code_gen_buffer) /
-                                     tcg_ctx.tb_ctx.nb_tbs : 0,
-                target_code_size ? (double) (tcg_ctx.code_gen_ptr -
-                                             tcg_ctx.code_gen_buffer) /
-                                             target_code_size : 0);
+            tb_ctx->nb_tbs ? gen_code_size / tb_ctx->nb_tbs : 0,
+            target_code_size ? (double) gen_code_size / target_code_size : 0);
     cpu_fprintf(f, "cross page TB count %d (%d%%)\n", cross_page,
             tcg_ctx.tb_ctx.nb_tbs ? (cross_page * 100) /
                                     tcg_ctx.tb_ctx.nb_tbs : 0);
@@ -1726,8 +1839,21 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
                 direct_jmp2_count,
                 tcg_ctx.tb_ctx.nb_tbs ? (direct_jmp2_count * 100) /
                         tcg_ctx.tb_ctx.nb_tbs : 0);
+    for (j = 0; j < tb_ctx->nb_regions; j++) {
+        TBRegion *r = &tb_ctx->regions[j];
+
+        cpu_fprintf(f, "region %-2d           %td/%td bytes, %d/%d TBs, "
+                    "used %u fills ago%s\n", j,
+                    tb_region_ptr(r) - tb_region_start(r),
+                    r->end - tb_region_start(r),
+                    r->nb_tbs, 1 << tb_ctx->region_tbs_bits,
+                    tb_ctx->generation - r->last_used,
+                    j == tb_ctx->cur_region ? " (current)" : "");
+    }
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %d\n", tcg_ctx.tb_ctx.tb_flush_count);
+    cpu_fprintf(f, "TB region evictions %d\n",
+                tcg_ctx.tb_ctx.tb_region_evict_count);
     cpu_fprintf(f, "TB invalidate count %d\n",
             tcg_ctx.tb_ctx.tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
@@ -1739,6 +1865,86 @@ void dump_opcount_info(FILE *f, fprintf_function cpu_fprintf)
     tcg_dump_op_count(f, cpu_fprintf);
 }
 
+/* Start or stop translating TBs with an execution counter.  Starting
+   flushes the TBs translated so far, so that all the code that runs
+   from then on is counted.  Stopping leaves the current TBs and their
+   counts alone.  The counts are only reported, hot TBs are never
+   translated again with more optimization: there is no second tier.  */
+void tb_set_profile(bool enable)
+{
+    tb_lock();
+    if (enable && !tcg_ctx.tb_ctx.profile) {
+        tb_flush(first_cpu);
+    }
+    tcg_ctx.tb_ctx.profile = enable;
+    tb_unlock();
+}
+
+typedef struct TBProfile {
+    TranslationBlock **tbs;
+    int nb_tbs;
+    uint64_t total;
+} TBProfile;
+
+/* Guest instructions run by @tb, our estimate of the time spent in it */
+static inline uint64_t tb_profile_weight(const TranslationBlock *tb)
+{
+    return tb->exec_count * tb->icount;
+}
+
+static void tb_profile_collect(QHT *ht, void *p, uint32_t hash, void *userp)
+{
+    TranslationBlock *tb = p;
+    TBProfile *prof = userp;
+
+    if ((tb->cflags & CF_PROFILE) && tb->exec_count) {
+        prof->tbs[prof->nb_tbs++] = tb;
+        prof->total += tb_profile_weight(tb);
+    }
+}
+
+static int tb_profile_cmp(const void *a, const void *b)
+{
+    uint64_t wa = tb_profile_weight(*(TranslationBlock * const *)a);
+    uint64_t wb = tb_profile_weight(*(TranslationBlock * const *)b);
+
+    return wa < wb ? 1 : wa > wb ? -1 : 0;
+}
+
+void dump_tb_profile(FILE *f, fprintf_function cpu_fprintf, int max_tbs)
+{
+    TBProfile prof;
+    int i;
+
+    if (!tcg_ctx.tb_ctx.profile) {
+        cpu_fprintf(f, "JIT profiling is off, enable it with 'jit-profile on'\n");
+    }
+
+    tb_lock();
+    prof.tbs = g_new(TranslationBlock *, tcg_ctx.tb_ctx.nb_tbs);
+    prof.nb_tbs = 0;
+    prof.total = 0;
+    qht_iter(&tcg_ctx.tb_ctx.htable, tb_profile_collect, &prof);
+    qsort(prof.tbs, prof.nb_tbs, sizeof(*prof.tbs), tb_profile_cmp);
+
+    cpu_fprintf(f, "%-18s %-18s %6s %14s %16s %6s\n", "guest PC", "host PC",
+                "insns", "executions", "guest insns", "share");
+    for (i = 0; i < MIN(prof.nb_tbs, max_tbs); i++) {
+        TranslationBlock *tb = prof.tbs[i];
+
+        cpu_fprintf(f, "0x" TARGET_FMT_lx "%*s %-18p %6d %14" PRIu64
+                    " %16" PRIu64 " %5.1f%%\n",
+                    tb->pc, (int)(16 - 2 * sizeof(target_ulong)), "",
+                    tb->tc_ptr, tb->icount, tb->exec_count,
+                    tb_profile_weight(tb),
+                    100.0 * tb_profile_weight(tb) / prof.total);
+    }
+    cpu_fprintf(f, "%d profiled TBs, %" PRIu64 " guest instructions\n",
+                prof.nb_tbs, prof.total);
+    g_free(prof.tbs);
+    tb_unlock();
+}
+
 #else /* CONFIG_USER_ONLY */
 
 void cpu_interrupt(CPUState *cpu, int mask)
@@ -0,0 +1,388 @@
+/*
+ * QHT: a concurrent hash table with lock-free lookups
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The table is an array of head buckets, each one cache line long, with
+ * overflow buckets chained off it.  Each bucket holds a few (hash, pointer)
+ * pairs, so a lookup usually touches a single cache line and compares the
+ * full hash before dereferencing any object.
+ *
+ * Writers serialize on ht->lock.  Readers take no lock at all: they run
+ * under RCU, and every writer bumps the sequence counter of the head
+ * bucket it modifies so that a reader that raced with an update can
+ * retry.  The entries of a chain are kept packed at its start: removal
+ * moves the last entry of the chain into the hole, and that move is what
+ * the sequence counter protects against.
+ *
+ * Overflow buckets are only freed together with the whole map.  When the
+ * table has grown too many of them, QHT_MODE_AUTO_RESIZE doubles the number
+ * of head buckets into a new map, publishes it, and frees the old one after
+ * a grace period.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include "qemu-common.h"
+#include "qemu/host-utils.h"
+#include "qemu/atomic.h"
+#include "qemu/rcu.h"
+#include "qemu/qht.h"
+
+#define QHT_BUCKET_ALIGN 64
+
+/* Fill a cache line with hashes and pointers */
+#if HOST_LONG_BITS == 32
+#define QHT_BUCKET_ENTRIES 6
+#else
+#define QHT_BUCKET_ENTRIES 4
+#endif
+
+/* Grow when the overflow buckets reach this fraction of the head buckets */
+#define QHT_ADDED_BUCKETS_DIV 8
+
+struct qht_bucket {
+    unsigned int sequence;
+    uint32_t hashes[QHT_BUCKET_ENTRIES];
+    void *pointers[QHT_BUCKET_ENTRIES];
+    struct qht_bucket *next;
+} __attribute__((aligned(QHT_BUCKET_ALIGN)));
+
+struct qht_map {
+    struct rcu_head rcu;
+    struct qht_bucket *buckets;
+    size_t n_buckets;
+    size_t n_added_buckets;
+    size_t n_added_buckets_threshold;
+};
+
+static inline unsigned int qht_seq_read_begin(const struct qht_bucket *b)
+{
+    unsigned int ret;
+
+    /* A writer holds ht->lock for a few stores at most, so just spin */
+    while ((ret = atomic_read(&b->sequence)) & 1) {
+        barrier();
+    }
+    smp_rmb();
+    return ret;
+}
+
+static inline bool qht_seq_read_retry(const struct qht_bucket *b,
+                                      unsigned int start)
+{
+    smp_rmb();
+    return unlikely(atomic_read(&b->sequence) != start);
+}
+
+static inline void qht_seq_write_begin(struct qht_bucket *b)
+{
+    atomic_set(&b->sequence, b->sequence + 1);
+    smp_wmb();
+}
+
+static inline void qht_seq_write_end(struct qht_bucket *b)
+{
+    smp_wmb();
+    atomic_set(&b->sequence, b->sequence + 1);
+}
+
+static struct qht_bucket *qht_bucket_new(void)
+{
+    struct qht_bucket *b;
+
+    b = qemu_memalign(QHT_BUCKET_ALIGN, sizeof(*b));
+    memset(b, 0, sizeof(*b));
+    return b;
+}
+
+static struct qht_map *qht_map_create(size_t n_buckets)
+{
+    struct qht_map *map = g_new0(struct qht_map, 1);
+
+    map->n_buckets = n_buckets;
+    map->n_added_buckets_threshold = MAX(n_buckets / QHT_ADDED_BUCKETS_DIV, 1);
+    map->buckets = qemu_memalign(QHT_BUCKET_ALIGN,
+                                 n_buckets * sizeof(*map->buckets));
+    memset(map->buckets, 0, n_buckets * sizeof(*map->buckets));
+    return map;
+}
+
+static void qht_map_destroy(struct qht_map *map)
+{
+    size_t i;
+
+    for (i = 0; i < map->n_buckets; i++) {
+        struct qht_bucket *b = map->buckets[i].next;
+
+        while (b) {
+            struct qht_bucket *next = b->next;
+            qemu_vfree(b);
+            b = next;
+        }
+    }
+    qemu_vfree(map->buckets);
+    g_free(map);
+}
+
+static inline struct qht_bucket *qht_map_to_bucket(struct qht_map *map,
+                                                   uint32_t hash)
+{
+    return &map->buckets[hash & (map->n_buckets - 1)];
+}
+
+void qht_init(QHT *ht, size_t n_elems, unsigned int mode)
+{
+    size_t n_buckets = pow2ceil(MAX(n_elems / QHT_BUCKET_ENTRIES, 1));
+
+    ht->mode = mode;
+    qemu_mutex_init(&ht->lock);
+    ht->map = qht_map_create(n_buckets);
+}
+
+void qht_destroy(QHT *ht)
+{
+    qht_map_destroy(ht->map);
+    qemu_mutex_destroy(&ht->lock);
+    memset(ht, 0, sizeof(*ht));
+}
+
+static void *qht_do_lookup(struct qht_bucket *head, qht_lookup_func_t func,
+                           const void *userp, uint32_t hash)
+{
+    struct qht_bucket *b = head;
+    int i;
+
+    do {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            if (atomic_read(&b->hashes[i]) == hash) {
+                void *p = atomic_rcu_read(&b->pointers[i]);
+
+                if (likely(p) && likely(func(p, userp))) {
+                    return p;
+                }
+            }
+        }
+        b = atomic_rcu_read(&b->next);
+    } while (b);
+
+    return NULL;
+}
+
+void *qht_lookup(QHT *ht, qht_lookup_func_t func, const void *userp,
+                 uint32_t hash)
+{
+    struct qht_map *map = atomic_rcu_read(&ht->map);
+    struct qht_bucket *b = qht_map_to_bucket(map, hash);
+    unsigned int version;
+    void *ret;
+
+    do {
+        version = qht_seq_read_begin(b);
+        ret = qht_do_lookup(b, func, userp, hash);
+    } while (qht_seq_read_retry(b, version));
+    return ret;
+}
+
+/*
+ * Add @p at the end of its chain.  Returns false if it is already there.
+ * Called with ht->lock held, or on a map that is not published yet.
+ */
+static bool qht_map_insert(struct qht_map *map, void *p, uint32_t hash,
+                           bool *added_bucket)
+{
+    struct qht_bucket *head = qht_map_to_bucket(map, hash);
+    struct qht_bucket *b = head;
+    struct qht_bucket *prev = NULL;
+    int i;
+
+    do {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            if (b->pointers[i] == NULL) {
+                goto found;
+            }
+            if (b->pointers[i] == p) {
+                return false;
+            }
+        }
+        prev = b;
+        b = b->next;
+    } while (b);
+
+    b = qht_bucket_new();
+    b->hashes[0] = hash;
+    b->pointers[0] = p;
+    qht_seq_write_begin(head);
+    atomic_rcu_set(&prev->next, b);
+    qht_seq_write_end(head);
+    map->n_added_buckets++;
+    *added_bucket = true;
+    return true;
+
+ found:
+    qht_seq_write_begin(head);
+    atomic_set(&b->hashes[i], hash);
+    atomic_set(&b->pointers[i], p);
+    qht_seq_write_end(head);
+    return true;
+}
+
+static void qht_grow(QHT *ht)
+{
+    struct qht_map *old = ht->map;
+    struct qht_map *new = qht_map_create(old->n_buckets * 2);
+    bool added = false;
+    size_t i;
+    int j;
+
+    for (i = 0; i < old->n_buckets; i++) {
+        struct qht_bucket *b;
+
+        for (b = &old->buckets[i]; b; b = b->next) {
+            for (j = 0; j < QHT_BUCKET_ENTRIES && b->pointers[j]; j++) {
+                qht_map_insert(new, b->pointers[j], b->hashes[j], &added);
+            }
+        }
+    }
+    atomic_rcu_set(&ht->map, new);
+    call_rcu(old, qht_map_destroy, rcu);
+}
+
+bool qht_insert(QHT *ht, void *p, uint32_t hash)
+{
+    struct qht_map *map;
+    bool added_bucket = false;
+    bool ret;
+
+    assert(p);
+    qemu_mutex_lock(&ht->lock);
+    map = ht->map;
+    ret = qht_map_insert(map, p, hash, &added_bucket);
+    if (added_bucket && (ht->mode & QHT_MODE_AUTO_RESIZE) &&
+        map->n_added_buckets > map->n_added_buckets_threshold) {
+        qht_grow(ht);
+    }
+    qemu_mutex_unlock(&ht->lock);
+    return ret;
+}
+
+bool qht_remove(QHT *ht, const void *p, uint32_t hash)
+{
+    struct qht_bucket *head, *b, *last_b;
+    int i, last_i;
+
+    qemu_mutex_lock(&ht->lock);
+    head = qht_map_to_bucket(ht->map, hash);
+    for (b = head; b; b = b->next) {
+        for (i = 0; i < QHT_BUCKET_ENTRIES && b->pointers[i]; i++) {
+            if (b->pointers[i] == p) {
+                goto found;
+            }
+        }
+    }
+    qemu_mutex_unlock(&ht->lock);
+    return false;
+
+ found:
+    /* Find the last entry in the chain, it will fill the hole */
+    last_b = b;
+    last_i = i;
+    for (;;) {
+        while (last_i + 1 < QHT_BUCKET_ENTRIES &&
+               last_b->pointers[last_i + 1]) {
+            last_i++;
+        }
+        if (last_i + 1 < QHT_BUCKET_ENTRIES || !last_b->next ||
+            !last_b->next->pointers[0]) {
+            break;
+        }
+        last_b = last_b->next;
+        last_i = 0;
+    }
+
+    qht_seq_write_begin(head);
+    if (last_b != b || last_i != i) {
+        atomic_set(&b->hashes[i], last_b->hashes[last_i]);
+        atomic_set(&b->pointers[i], last_b->pointers[last_i]);
+    }
+    atomic_set(&last_b->pointers[last_i], NULL);
+    qht_seq_write_end(head);
+
+    qemu_mutex_unlock(&ht->lock);
+    return true;
+}
+
+void qht_reset(QHT *ht)
+{
+    struct qht_map *map;
+    struct qht_bucket *b;
+    size_t i;
+    int j;
+
+    qemu_mutex_lock(&ht->lock);
+    map = ht->map;
+    for (i = 0; i < map->n_buckets; i++) {
+        struct qht_bucket *head = &map->buckets[i];
+
+        if (!head->pointers[0]) {
+            continue;
+        }
+        qht_seq_write_begin(head);
+        for (b = head; b; b = b->next) {
+            for (j = 0; j < QHT_BUCKET_ENTRIES; j++) {
+                atomic_set(&b->pointers[j], NULL);
+            }
+        }
+        qht_seq_write_end(head);
+    }
+    qemu_mutex_unlock(&ht->lock);
+}
+
+void qht_iter(QHT *ht, qht_iter_func_t func, void *userp)
+{
+    struct qht_map *map;
+    struct qht_bucket *b;
+    size_t i;
+    int j;
+
+    qemu_mutex_lock(&ht->lock);
+    map = ht->map;
+    for (i = 0; i < map->n_buckets; i++) {
+        for (b = &map->buckets[i]; b; b = b->next) {
+            for (j = 0; j < QHT_BUCKET_ENTRIES && b->pointers[j]; j++) {
+                func(ht, b->pointers[j], b->hashes[j], userp);
+            }
+        }
+    }
+    qemu_mutex_unlock(&ht->lock);
+}
+
+void qht_statistics(QHT *ht, QHTStats *stats)
+{
+    struct qht_map *map;
+    struct qht_bucket *b;
+    size_t i;
+    int j;
+
+    memset(stats, 0, sizeof(*stats));
+    qemu_mutex_lock(&ht->lock);
+    map = ht->map;
+    stats->head_buckets = map->n_buckets;
+    for (i = 0; i < map->n_buckets; i++) {
+        size_t chain = 0;
+
+        b = &map->buckets[i];
+        if (b->pointers[0]) {
+            stats->used_head_buckets++;
+        }
+        for (; b; b = b->next) {
+            for (j = 0; j < QHT_BUCKET_ENTRIES && b->pointers[j]; j++) {
+                stats->entries++;
+            }
+            chain++;
+        }
+        stats->max_chain = MAX(stats->max_chain, chain);
+    }
+    qemu_mutex_unlock(&ht->lock);
+}